@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bimap.h"
+#include "benchmark/benchmark.h"
+
+// Sizes go from 1K up to BIMAP_BENCH_MAX_SIZE pairs. The largest string
+// maps need several gigabytes, so define a smaller limit (or use
+// --benchmark_filter) on machines without that much memory.
+#ifndef BIMAP_BENCH_MAX_SIZE
+#define BIMAP_BENCH_MAX_SIZE 50000000
+#endif
+
+namespace {
+const uint64_t seed = 1488228;
+
+// Baseline: two std::map kept in sync, the usual bimap stand-in.
+template <typename Left, typename Right>
+class two_maps {
+public:
+  using left_t = Left;
+  using right_t = Right;
+  using left_iterator = typename std::map<Left, Right>::const_iterator;
+
+  bool insert(Left const& left, Right const& right) {
+    if (lefts.count(left) != 0 || rights.count(right) != 0) {
+      return false;
+    }
+
+    lefts.emplace(left, right);
+    rights.emplace(right, left);
+    return true;
+  }
+
+  // Hints both maps with the last pair, as bimap does with the pair of hint.
+  left_iterator insert(left_iterator hint, Left const& left,
+                       Right const& right) {
+    if (lefts.count(left) != 0 || rights.count(right) != 0) {
+      return lefts.end();
+    }
+
+    auto right_hint = hint == lefts.end() ? rights.end() : flip(hint);
+    rights.emplace_hint(right_hint, right, left);
+    return lefts.emplace_hint(hint, left, right);
+  }
+
+  bool erase_left(Left const& left) {
+    auto it = lefts.find(left);
+    if (it == lefts.end()) {
+      return false;
+    }
+
+    rights.erase(it->second);
+    lefts.erase(it);
+    return true;
+  }
+
+  left_iterator find_left(Left const& left) const {
+    return lefts.find(left);
+  }
+
+  auto find_right(Right const& right) const {
+    return rights.find(right);
+  }
+
+  left_iterator lower_bound_left(Left const& left) const {
+    return lefts.lower_bound(left);
+  }
+
+  auto lower_bound_right(Right const& right) const {
+    return rights.lower_bound(right);
+  }
+
+  left_iterator begin_left() const {
+    return lefts.begin();
+  }
+
+  left_iterator end_left() const {
+    return lefts.end();
+  }
+
+  // Counterpart of bimap's flip(): one more lookup in the other map.
+  auto flip(left_iterator it) const {
+    return rights.find(it->second);
+  }
+
+  size_t size() const {
+    return lefts.size();
+  }
+
+private:
+  std::map<Left, Right> lefts;
+  std::map<Right, Left> rights;
+};
+
+template <typename Left, typename Right>
+auto flip(bimap<Left, Right> const&,
+          typename bimap<Left, Right>::left_iterator it) {
+  return it.flip();
+}
+
+template <typename Left, typename Right>
+auto flip(two_maps<Left, Right> const& map,
+          typename two_maps<Left, Right>::left_iterator it) {
+  return map.flip(it);
+}
+
+template <typename Key>
+Key make_key(uint64_t value);
+
+template <>
+int make_key<int>(uint64_t value) {
+  return static_cast<int>(value);
+}
+
+// Longer than the small string buffer, so every key owns a heap block like
+// the keys of real services do.
+template <>
+std::string make_key<std::string>(uint64_t value) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "key-%020llu",
+                static_cast<unsigned long long>(value));
+  return buffer;
+}
+
+// n distinct keys in random order.
+template <typename Key>
+std::vector<Key> make_keys(size_t n, uint64_t salt) {
+  std::vector<uint64_t> values(n);
+  std::iota(values.begin(), values.end(), 0);
+  std::shuffle(values.begin(), values.end(), std::mt19937_64(seed + salt));
+
+  std::vector<Key> keys;
+  keys.reserve(n);
+  for (auto value : values) {
+    keys.push_back(make_key<Key>(value));
+  }
+  return keys;
+}
+
+template <typename Map>
+struct data_set {
+  using left_t = typename Map::left_t;
+  using right_t = typename Map::right_t;
+
+  explicit data_set(size_t n)
+      : lefts(make_keys<left_t>(n, 1)), rights(make_keys<right_t>(n, 2)) {}
+
+  void fill(Map& map) const {
+    for (size_t i = 0; i < lefts.size(); ++i) {
+      map.insert(lefts[i], rights[i]);
+    }
+  }
+
+  std::vector<left_t> lefts;
+  std::vector<right_t> rights;
+};
+
+template <typename Map>
+void BM_insert(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  for (auto _ : state) {
+    auto* map = new Map();
+    data.fill(*map);
+    benchmark::DoNotOptimize(map->size());
+
+    state.PauseTiming();
+    delete map;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Keys arrive in increasing order and every insert is hinted with the
+// previous one.
+template <typename Map>
+void BM_insert_sorted_hint(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  std::sort(data.lefts.begin(), data.lefts.end());
+  std::sort(data.rights.begin(), data.rights.end());
+
+  for (auto _ : state) {
+    auto* map = new Map();
+    auto hint = map->end_left();
+    for (size_t i = 0; i < data.lefts.size(); ++i) {
+      hint = map->insert(hint, data.lefts[i], data.rights[i]);
+    }
+    benchmark::DoNotOptimize(map->size());
+
+    state.PauseTiming();
+    delete map;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Map>
+void BM_erase(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    Map map;
+    data.fill(map);
+    state.ResumeTiming();
+
+    for (auto const& left : data.lefts) {
+      map.erase_left(left);
+    }
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Lookups run in random key order, one per iteration.
+template <typename Map>
+void BM_find_left(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  Map map;
+  data.fill(map);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.find_left(data.lefts[i]));
+    i = i + 1 == data.lefts.size() ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Map>
+void BM_find_right(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  Map map;
+  data.fill(map);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.find_right(data.rights[i]));
+    i = i + 1 == data.rights.size() ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Lookups in batches of 128 keys, as a request handler would do them.
+template <typename Map>
+void BM_find_left_batch(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  Map map;
+  data.fill(map);
+
+  const size_t batch = 128;
+  std::vector<typename Map::left_iterator> found(batch);
+  size_t i = 0;
+  for (auto _ : state) {
+    size_t n = std::min(batch, data.lefts.size() - i);
+    auto keys = data.lefts.begin() + i;
+    map.find_left_batch(keys, keys + n, found.begin());
+    benchmark::DoNotOptimize(found.data());
+    i = i + n == data.lefts.size() ? 0 : i + n;
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+
+template <typename Map>
+void BM_lower_bound_left(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  Map map;
+  data.fill(map);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.lower_bound_left(data.lefts[i]));
+    i = i + 1 == data.lefts.size() ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Map>
+void BM_lower_bound_right(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  Map map;
+  data.fill(map);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.lower_bound_right(data.rights[i]));
+    i = i + 1 == data.rights.size() ? 0 : i + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Map>
+void BM_iterate(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  Map map;
+  data.fill(map);
+
+  for (auto _ : state) {
+    for (auto it = map.begin_left(); it != map.end_left(); ++it) {
+      benchmark::DoNotOptimize(*it);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Map>
+void BM_flip(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  Map map;
+  data.fill(map);
+
+  for (auto _ : state) {
+    for (auto it = map.begin_left(); it != map.end_left(); ++it) {
+      benchmark::DoNotOptimize(flip(map, it));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Map>
+void BM_copy(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  Map map;
+  data.fill(map);
+
+  for (auto _ : state) {
+    auto* copy = new Map(map);
+    benchmark::DoNotOptimize(copy->size());
+
+    state.PauseTiming();
+    delete copy;
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Map>
+void BM_destroy(benchmark::State& state) {
+  data_set<Map> data(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto* map = new Map();
+    data.fill(*map);
+    state.ResumeTiming();
+
+    delete map;
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void sizes(benchmark::internal::Benchmark* b) {
+  for (int64_t n : {int64_t(1) << 10, int64_t(1) << 14, int64_t(1) << 17,
+                    int64_t(1) << 20, int64_t(1) << 23, int64_t(50000000)}) {
+    if (n <= BIMAP_BENCH_MAX_SIZE) {
+      b->Arg(n);
+    }
+  }
+}
+
+using int_bimap = bimap<int, int>;
+using int_two_maps = two_maps<int, int>;
+using string_bimap = bimap<std::string, std::string>;
+using string_two_maps = two_maps<std::string, std::string>;
+} // namespace
+
+#define BIMAP_BENCHMARK(name)                                                 \
+  BENCHMARK_TEMPLATE(name, int_bimap)->Apply(sizes);                          \
+  BENCHMARK_TEMPLATE(name, int_two_maps)->Apply(sizes);                       \
+  BENCHMARK_TEMPLATE(name, string_bimap)->Apply(sizes);                       \
+  BENCHMARK_TEMPLATE(name, string_two_maps)->Apply(sizes)
+
+BIMAP_BENCHMARK(BM_insert);
+BIMAP_BENCHMARK(BM_insert_sorted_hint);
+BIMAP_BENCHMARK(BM_erase);
+BIMAP_BENCHMARK(BM_find_left);
+BIMAP_BENCHMARK(BM_find_right);
+BENCHMARK_TEMPLATE(BM_find_left_batch, int_bimap)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_find_left_batch, string_bimap)->Apply(sizes);
+BIMAP_BENCHMARK(BM_lower_bound_left);
+BIMAP_BENCHMARK(BM_lower_bound_right);
+BIMAP_BENCHMARK(BM_iterate);
+BIMAP_BENCHMARK(BM_flip);
+BIMAP_BENCHMARK(BM_copy);
+BIMAP_BENCHMARK(BM_destroy);
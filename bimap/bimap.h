@@ -1,18 +1,47 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "binode.h"
-
+#include "executor.h"
+#include "frozen_bimap.h"
+#include "slab_allocator.h"
+#include "stats.h"
+
+// SizePolicy задает, что узлы хранят о своих поддеревьях:
+// - bimap_impl::subtree_sizes<size_t> (по умолчанию) -- размеры поддеревьев,
+//   на которых работают nth, rank, count_range и арифметика итераторов;
+// - bimap_impl::subtree_sizes<uint32_t> -- то же, но в 32 битах: не больше
+//   2^32 - 2 пар, зато маленький ключ делит слово с размером;
+// - bimap_impl::no_subtree_sizes -- без размеров: узел меньше, вставка и
+//   удаление не обновляют размеры до корня, но nth, rank, count_range,
+//   freeze, арифметика и сравнение итераторов на < не компилируются, а
+//   итераторы только двунаправленные.
 template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
-          typename CompareRight = std::less<Right>>
+          typename CompareRight = std::less<Right>,
+          typename Allocator = std::allocator<std::pair<Left, Right>>,
+          typename SizePolicy = bimap_impl::subtree_sizes<size_t>>
 class bimap {
 public:
   using left_tag = bimap_impl::left_tag;
   using right_tag = bimap_impl::right_tag;
 
-  using binode_t = bimap_impl::binode<Left, Right>;
+  using binode_t = bimap_impl::binode<Left, Right, SizePolicy>;
+
+  using allocator_type = Allocator;
+  using node_allocator_t = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<binode_t>;
+  using node_allocator_traits_t = std::allocator_traits<node_allocator_t>;
 
   template <typename Tag, typename = void>
   struct traits;
@@ -23,9 +52,9 @@ public:
     using tag = left_tag;
     using half_t = Left;
     using compare_half_t = CompareLeft;
-    using half_node_t = bimap_impl::node<Left, left_tag>;
+    using half_node_t = typename binode_t::left_node_t;
     using half_tree_t =
-        bimap_impl::treap<binode_t, Left, CompareLeft, left_tag>;
+        bimap_impl::treap<binode_t, Left, CompareLeft, left_tag, SizePolicy>;
     using half_tree_iterator_t = typename half_tree_t::const_iterator;
   };
 
@@ -35,9 +64,9 @@ public:
     using tag = right_tag;
     using half_t = Right;
     using compare_half_t = CompareRight;
-    using half_node_t = bimap_impl::node<Right, right_tag>;
+    using half_node_t = typename binode_t::right_node_t;
     using half_tree_t =
-        bimap_impl::treap<binode_t, Right, CompareRight, right_tag>;
+        bimap_impl::treap<binode_t, Right, CompareRight, right_tag, SizePolicy>;
     using half_tree_iterator_t = typename half_tree_t::const_iterator;
   };
 
@@ -54,7 +83,8 @@ public:
   using right_tree_iterator_t =
       typename traits<right_tag>::half_tree_iterator_t;
 
-  struct tree_pair : left_tree_t, right_tree_t {};
+  // Allocator is kept next to the trees so that an empty one takes no space.
+  struct tree_pair : left_tree_t, right_tree_t, node_allocator_t {};
 
   template <typename From, typename To>
   static const To& opposite(const From& from) noexcept {
@@ -64,12 +94,16 @@ public:
   template <typename Tag>
   class iterator_impl {
   public:
-    using iterator_category = std::bidirectional_iterator_tag;
+    using iterator_category =
+        typename traits<Tag>::half_tree_iterator_t::iterator_category;
     using value_type = typename traits<Tag>::half_t;
     using difference_type = std::ptrdiff_t;
     using pointer = value_type*;
     using reference = value_type&;
 
+    // Сингулярный итератор: его можно только присвоить или уничтожить.
+    iterator_impl() noexcept = default;
+
     iterator_impl(const binode_t& binode) noexcept : cur(&binode.template as_node<Tag>()) {}
 
     // Элемент на который сейчас ссылается итератор.
@@ -107,6 +141,41 @@ public:
       return cur--;
     }
 
+    // Сдвиг на n позиций и расстояние между итераторами.
+    // Работают за O(log n) с помощью размеров поддеревьев, поэтому и
+    // std::distance, и std::next работают за O(log n).
+    // Без размеров поддеревьев (no_subtree_sizes) не компилируются.
+    // Выход за пределы [begin, end] неопределен.
+    iterator_impl& operator+=(difference_type n) {
+      cur += n;
+      return *this;
+    }
+
+    iterator_impl& operator-=(difference_type n) {
+      cur -= n;
+      return *this;
+    }
+
+    iterator_impl operator+(difference_type n) const {
+      return cur + n;
+    }
+
+    friend iterator_impl operator+(difference_type n, const iterator_impl& it) {
+      return it + n;
+    }
+
+    iterator_impl operator-(difference_type n) const {
+      return cur - n;
+    }
+
+    difference_type operator-(const iterator_impl& other) const {
+      return cur - other.cur;
+    }
+
+    value_type const& operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
     // left_iterator ссылается на левый элемент некоторой пары.
     // Эта функция возвращает итератор на правый элемент той же пары.
     // end_left().flip() возращает end_right().
@@ -129,6 +198,22 @@ public:
       return cur != other.cur;
     }
 
+    bool operator<(const iterator_impl& other) const noexcept {
+      return cur < other.cur;
+    }
+
+    bool operator>(const iterator_impl& other) const noexcept {
+      return cur > other.cur;
+    }
+
+    bool operator<=(const iterator_impl& other) const noexcept {
+      return cur <= other.cur;
+    }
+
+    bool operator>=(const iterator_impl& other) const noexcept {
+      return cur >= other.cur;
+    }
+
     friend bimap;
 
   private:
@@ -145,20 +230,122 @@ public:
   using left_iterator = iterator_impl<left_tag>;
   using right_iterator = iterator_impl<right_tag>;
 
+  // Пара, извлеченная из bimap вместе со своим узлом (см. extract_left).
+  // Владеет узлом: пока пара не вставлена обратно, ее left и right можно
+  // менять, а непустой node_type при разрушении освобождает узел.
+  class node_type {
+  public:
+    node_type() noexcept = default;
+
+    node_type(node_type&& other) noexcept
+        : node(std::exchange(other.node, nullptr)),
+          alloc(std::move(other.alloc)) {}
+
+    node_type& operator=(node_type&& other) noexcept {
+      if (this != &other) {
+        reset();
+        node = std::exchange(other.node, nullptr);
+        alloc = std::move(other.alloc);
+      }
+      return *this;
+    }
+
+    ~node_type() {
+      reset();
+    }
+
+    bool empty() const noexcept {
+      return node == nullptr;
+    }
+
+    explicit operator bool() const noexcept {
+      return !empty();
+    }
+
+    // Доступ к пустому node_type неопределен.
+    left_t& left() const noexcept {
+      return node->template half<left_tag>();
+    }
+
+    right_t& right() const noexcept {
+      return node->template half<right_tag>();
+    }
+
+    allocator_type get_allocator() const {
+      return allocator_type(*alloc);
+    }
+
+  private:
+    friend bimap;
+
+    node_type(binode_t* node, const node_allocator_t& alloc) noexcept
+        : node(node), alloc(alloc) {}
+
+    binode_t* release() noexcept {
+      alloc.reset();
+      return std::exchange(node, nullptr);
+    }
+
+    void reset() noexcept {
+      if (node) {
+        node_allocator_traits_t::destroy(*alloc, node);
+        node_allocator_traits_t::deallocate(*alloc, node, 1);
+        node = nullptr;
+      }
+      alloc.reset();
+    }
+
+    binode_t* node = nullptr;
+    std::optional<node_allocator_t> alloc;
+  };
+
   // Создает bimap не содержащий ни одной пары.
   bimap(CompareLeft compare_left = CompareLeft(),
-        CompareRight compare_right = CompareRight())
-      : trees{left_tree_t(compare_left), right_tree_t(compare_right)} {}
+        CompareRight compare_right = CompareRight(),
+        Allocator alloc = Allocator())
+      : trees{left_tree_t(std::move(compare_left)),
+              right_tree_t(std::move(compare_right)),
+              node_allocator_t(std::move(alloc))} {}
 
   // Конструкторы от других и присваивания
-  bimap(bimap const& other) {
-    for (auto it = other.begin_left(); it != other.end_left(); ++it) {
-      insert(*it, *it.flip());
-    }
+  // Копия получает деревья той же формы за O(n) в среднем, other только
+  // читается.
+  bimap(bimap const& other)
+      : trees{left_tree_t(other.tree<left_tag>().key_comp()),
+              right_tree_t(other.tree<right_tag>().key_comp()),
+              node_allocator_traits_t::select_on_container_copy_construction(
+                  other.node_allocator())} {
+    clone(other);
   }
 
   bimap(bimap&& other) noexcept = default;
 
+  // Строит bimap по последовательности пар, отсортированной по left.
+  // Левое дерево строится за линейное время, для правого сортируются
+  // указатели на уже созданные узлы.
+  // Результат совпадает с последовательными insert всех пар по порядку:
+  // пары с уже вставленным left или right пропускаются.
+  template <typename InputIt>
+  static bimap from_sorted(InputIt first, InputIt last,
+                           CompareLeft compare_left = CompareLeft(),
+                           CompareRight compare_right = CompareRight(),
+                           Allocator alloc = Allocator()) {
+    bimap result(std::move(compare_left), std::move(compare_right),
+                 std::move(alloc));
+    result.build_sorted(first, last);
+    return result;
+  }
+
+  // Заменяет содержимое на пары из отсортированной по left
+  // последовательности, см. from_sorted.
+  template <typename InputIt>
+  void assign_sorted(InputIt first, InputIt last) {
+    bimap result(tree<left_tag>().key_comp(), tree<right_tag>().key_comp(),
+                 get_allocator());
+    result.build_sorted(first, last);
+    swap(result);
+  }
+
   bimap& operator=(bimap const& other) {
     if (&other == this) {
       return *this;
@@ -170,39 +357,215 @@ public:
     return *this;
   }
 
-  bimap& operator=(bimap&& other) noexcept = default;
+  // Узлы принадлежат аллокатору, поэтому присваивание обменивает их вместе с
+  // ним, а не переносит деревья под чужой аллокатор.
+  bimap& operator=(bimap&& other) noexcept {
+    if (&other == this) {
+      return *this;
+    }
+
+    bimap moved(std::move(other));
+    swap(moved);
+
+    return *this;
+  }
 
   void swap(bimap& other) noexcept {
-    std::swap(tree<left_tag>(), other.tree<left_tag>());
-    std::swap(tree<right_tag>(), other.tree<right_tag>());
+    using std::swap;
+    swap(tree<left_tag>(), other.tree<left_tag>());
+    swap(tree<right_tag>(), other.tree<right_tag>());
+    swap(node_allocator(), other.node_allocator());
+  }
+
+  // Задает зерно генератора приоритетов декартовых деревьев. Два bimap с
+  // одинаковым зерном после одинаковых последовательностей операций имеют
+  // одинаковую форму деревьев, что позволяет воспроизводить прогоны.
+  // По умолчанию зерно выводится из адреса объекта.
+  void reseed(uint64_t seed) noexcept {
+    rand_rank.seed(seed);
+  }
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type(node_allocator());
   }
 
   // Деструктор. Вызывается при удалении объектов bimap.
   // Инвалидирует все итераторы ссылающиеся на элементы этого bimap
   // (включая итераторы ссылающиеся на элементы следующие за последними).
   ~bimap() noexcept {
-    while (!empty()) {
-      erase_left(--end_left());
+    clear();
+  }
+
+  // Удаляет все пары за O(n) одним обходом дерева, без перебалансировки.
+  // Если узлы лежат в slab_allocator, которым больше никто не пользуется, и
+  // left_t и right_t тривиально разрушаемы, арена освобождается целиком.
+  // Инвалидирует все итераторы, кроме end_left() и end_right().
+  void clear() noexcept {
+    if constexpr (bimap_impl::is_slab_allocator<node_allocator_t>::value &&
+                  std::is_trivially_destructible_v<left_t> &&
+                  std::is_trivially_destructible_v<right_t>) {
+      if (node_allocator().reset_if_unique()) {
+#ifdef BIMAP_STATS
+        deallocations.add(size());
+#endif
+        tree<left_tag>().forget();
+        tree<right_tag>().forget();
+        return;
+      }
     }
+
+    tree<right_tag>().forget();
+    tree<left_tag>().clear([this](binode_t& node) { destroy_node(node); });
   }
 
   // Вставка пары (left, right), возвращает итератор на left.
   // Если такой left или такой right уже присутствуют в bimap, вставка не
   // производится и возвращается end_left().
-  left_iterator insert(left_t left, right_t right) {
-    if (tree<left_tag>().find(left) != tree<left_tag>().end()) {
+  // Каждое дерево проходится один раз, и найденное место используется для
+  // вставки. left и right копируются или перемещаются прямо в узел;
+  // аргументы другого типа сначала преобразуются в left_t и right_t.
+  template <typename L = left_t, typename R = right_t>
+  left_iterator insert(L&& left, R&& right) {
+    return insert(end_left(), std::forward<L>(left), std::forward<R>(right));
+  }
+
+  // Вставка с подсказкой: место для left ищется от hint вверх и затем вниз,
+  // а место для right - от парного к hint элемента. Если left окажется рядом
+  // с hint (например, hint - результат предыдущего insert при вставке почти
+  // по возрастанию), вставка стоит амортизированно O(1) вместо O(log n).
+  // Подсказка влияет только на скорость; end_left() ищет от корня.
+  template <typename L = left_t, typename R = right_t>
+  left_iterator insert(left_iterator hint, L&& left, R&& right) {
+    if constexpr (!std::is_same_v<std::decay_t<L>, left_t>) {
+      return insert(hint, left_t(std::forward<L>(left)),
+                    std::forward<R>(right));
+    } else if constexpr (!std::is_same_v<std::decay_t<R>, right_t>) {
+      return insert(hint, std::forward<L>(left),
+                    right_t(std::forward<R>(right)));
+    } else {
+      auto left_position = tree<left_tag>().locate(hint.cur, left);
+      if (left_position.child) {
+        return end_left();
+      }
+
+      auto right_position = tree<right_tag>().locate(hint.flip().cur, right);
+      if (right_position.child) {
+        return end_left();
+      }
+
+      auto* b = create_node(std::forward<L>(left), std::forward<R>(right),
+                            rand_rank());
+      return link_at(left_position, right_position, *b);
+    }
+  }
+
+  // Создает пару на месте: left из аргументов left_args, right из
+  // right_args (как std::pair). Если такой left или такой right уже
+  // присутствуют, созданный узел удаляется и возвращается end_left().
+  template <typename... LeftArgs, typename... RightArgs>
+  left_iterator emplace(std::piecewise_construct_t,
+                        std::tuple<LeftArgs...> left_args,
+                        std::tuple<RightArgs...> right_args) {
+    auto* b = create_node(std::piecewise_construct, std::move(left_args),
+                          std::move(right_args), rand_rank());
+    auto left_position = tree<left_tag>().locate(b->template half<left_tag>());
+    auto right_position =
+        tree<right_tag>().locate(b->template half<right_tag>());
+    if (left_position.child || right_position.child) {
+      destroy_node(*b);
+      return end_left();
+    }
+
+    return link_at(left_position, right_position, *b);
+  }
+
+  template <typename L, typename R>
+  left_iterator emplace(L&& left, R&& right) {
+    return emplace(std::piecewise_construct,
+                   std::forward_as_tuple(std::forward<L>(left)),
+                   std::forward_as_tuple(std::forward<R>(right)));
+  }
+
+  // Если left уже присутствует, возвращает end_left(), не трогая ни left,
+  // ни args. Иначе создает right из args и вставляет пару, как emplace.
+  // Если занят right, left может оказаться перемещенным.
+  template <typename... Args>
+  left_iterator try_emplace_left(left_t const& left, Args&&... args) {
+    return try_emplace_impl<left_tag>(left, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  left_iterator try_emplace_left(left_t&& left, Args&&... args) {
+    return try_emplace_impl<left_tag>(std::move(left),
+                                      std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  left_iterator try_emplace_right(right_t const& right, Args&&... args) {
+    return try_emplace_impl<right_tag>(right, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  left_iterator try_emplace_right(right_t&& right, Args&&... args) {
+    return try_emplace_impl<right_tag>(std::move(right),
+                                       std::forward<Args>(args)...);
+  }
+
+  // Вставляет пару из node, не перевыделяя узел. Если такой left или такой
+  // right уже присутствуют, вставка не производится, node остается
+  // нетронутым и возвращается end_left(); то же для пустого node.
+  // Аллокатор node должен быть равен аллокатору bimap.
+  // Как и insert, проходит каждое дерево один раз.
+  left_iterator insert(node_type&& node) {
+    if (node.empty()) {
+      return end_left();
+    }
+
+    auto left_position = tree<left_tag>().locate(node.left());
+    if (left_position.child) {
       return end_left();
     }
 
-    if (tree<right_tag>().find(right) != tree<right_tag>().end()) {
+    auto right_position = tree<right_tag>().locate(node.right());
+    if (right_position.child) {
       return end_left();
     }
 
-    auto* b = new binode_t(std::move(left), std::move(right), rand_rank());
-    tree<left_tag>().insert(*b);
-    tree<right_tag>().insert(*b);
+    return link_at(left_position, right_position, *node.release());
+  }
+
+  // Извлекает пару из bimap вместе с ее узлом, без копирования ключей и
+  // освобождения памяти. Инвалидирует итераторы на извлеченную пару.
+  // extract(end_left()) и extract(end_right()) неопределены.
+  node_type extract_left(left_iterator it) {
+    return extract_impl<left_tag>(it);
+  }
+
+  node_type extract_right(right_iterator it) {
+    return extract_impl<right_tag>(it);
+  }
+
+  // Аналогично, но по ключу; если ключа нет, возвращает пустой node_type.
+  node_type extract_left(left_t const& left) {
+    auto it = find_left(left);
+    return it != end_left() ? extract_impl<left_tag>(it) : node_type();
+  }
+
+  node_type extract_right(right_t const& right) {
+    auto it = find_right(right);
+    return it != end_right() ? extract_impl<right_tag>(it) : node_type();
+  }
 
-    return *b;
+  // Заменяет right в паре, на которую указывает it, перевешивая узел только
+  // в дереве right'ов. Если right уже встречается в другой паре, ничего не
+  // делает и возвращает false. Итераторы на пару остаются валидными.
+  // Если присваивание right_t бросает исключение, пара удаляется.
+  bool replace_right(left_iterator it, right_t right) {
+    return replace_impl<right_tag>(*it.cur, std::move(right));
+  }
+
+  bool replace_left(right_iterator it, left_t left) {
+    return replace_impl<left_tag>(*it.cur, std::move(left));
   }
 
   // Удаляет элемент и соответствующий ему парный.
@@ -238,6 +601,95 @@ public:
     return erase_impl<right_tag>(first, last);
   }
 
+  // Вставляет пары из [first, last) с тем же результатом, что и
+  // последовательные insert. Проверка конфликтов с уже имеющимися парами,
+  // сортировка новых пар и объединение деревьев выполняются на executor
+  // (см. bimap_impl::thread_executor). Узлы создаются в вызывающем потоке,
+  // поэтому аллокатор не обязан быть потокобезопасным.
+  template <typename InputIt,
+            typename Executor = bimap_impl::sequential_executor>
+  void insert_bulk(InputIt first, InputIt last,
+                   const Executor& executor = Executor()) {
+    bimap bulk(tree<left_tag>().key_comp(), tree<right_tag>().key_comp(),
+               get_allocator());
+    bulk.build(bulk.create_nodes(first, last), false, this, executor);
+    merge(bulk, executor);
+  }
+
+  // Переносит из source пары, у которых ни left, ни right не встречаются в
+  // *this, остальные пары остаются в source. Узлы не копируются и не
+  // перевыделяются, деревья объединяются через split/merge за
+  // O(m log(n / m + 1)) плюс O(k log k) на k оставшихся в source пар.
+  // Независимые половины объединения выполняются на executor.
+  // Итераторы на перенесенные пары остаются валидными и ссылаются на *this.
+  template <typename Executor = bimap_impl::sequential_executor>
+  void merge(bimap& source, const Executor& executor = Executor()) {
+    if (&source == this) {
+      return;
+    }
+
+    if (node_allocator() != source.node_allocator()) {
+      for (auto it = source.begin_left(); it != source.end_left();) {
+        if (insert(*it, *it.flip()) != end_left()) {
+          it = source.erase_left(it);
+        } else {
+          ++it;
+        }
+      }
+      return;
+    }
+
+    auto& source_left = source.tree<left_tag>();
+    auto& source_right = source.tree<right_tag>();
+
+    // pairs rejected by the left side go back to the left tree of source
+    // and are taken out of its right tree before that one is united
+    tree<left_tag>().unite(source_left, executor,
+                           [&](binode_t& node) { source_left.insert(node); });
+    for (auto it = source_left.begin(); it != source_left.end(); ++it) {
+      source_right.erase(*it);
+    }
+
+    tree<right_tag>().unite(source_right, executor, [&](binode_t& node) {
+      tree<left_tag>().erase(node);
+      source_left.insert(node);
+    });
+    for (auto it = source_left.begin(); it != source_left.end(); ++it) {
+      source_right.insert(const_cast<binode_t&>(*it));
+    }
+  }
+
+  template <typename Executor = bimap_impl::sequential_executor>
+  void merge(bimap&& source, const Executor& executor = Executor()) {
+    merge(source, executor);
+  }
+
+  // Переносит пары полуинтервала [first, last) в новый bimap с теми же
+  // компараторами и аллокатором. Сторона, по которой задан полуинтервал,
+  // разрезается за O(log n), пары на противоположной стороне переносятся по
+  // одной.
+  bimap extract_range_left(left_iterator first, left_iterator last) {
+    return extract_range_impl<left_tag>(first, last);
+  }
+
+  bimap extract_range_right(right_iterator first, right_iterator last) {
+    return extract_range_impl<right_tag>(first, last);
+  }
+
+  // Удаляет пары, которые есть в other (совпадают и left, и right).
+  // Работает по деревьям за O(m log(n / m + 1)) плюс O(log n) на каждую
+  // удаленную пару.
+  template <typename Executor = bimap_impl::sequential_executor>
+  void subtract(bimap const& other, const Executor& executor = Executor()) {
+    filter_impl(other, true, executor);
+  }
+
+  // Оставляет только пары, которые есть в other.
+  template <typename Executor = bimap_impl::sequential_executor>
+  void intersect(bimap const& other, const Executor& executor = Executor()) {
+    filter_impl(other, false, executor);
+  }
+
   // Возвращает итератор по элементу. Если не найден - соответствующий end()
   left_iterator find_left(left_t const& left) const noexcept {
     return find_impl<left_tag>(left);
@@ -247,6 +699,40 @@ public:
     return find_impl<right_tag>(right);
   }
 
+  // Поиск по ключу другого типа без создания временного left_t/right_t.
+  // Доступен, если компаратор прозрачный (объявляет is_transparent, как
+  // std::less<>). То же верно для at, lower_bound, upper_bound, rank и
+  // count_range.
+  template <typename K, typename C = CompareLeft,
+            typename = typename C::is_transparent>
+  left_iterator find_left(K const& left) const noexcept {
+    return find_impl<left_tag>(left);
+  }
+
+  template <typename K, typename C = CompareRight,
+            typename = typename C::is_transparent>
+  right_iterator find_right(K const& right) const noexcept {
+    return find_impl<right_tag>(right);
+  }
+
+  // Пакетный поиск: out[i] получает find_left(first[i]) для каждого ключа
+  // из [first, last). Спуски по дереву для нескольких ключей чередуются с
+  // предвыборкой узлов, поэтому промахи кэша разных ключей перекрываются.
+  // Полезно, когда ключей десятки и больше. Возвращает итератор за последним
+  // записанным элементом out. Ключи могут быть любого типа, с которым
+  // сравнивается компаратор.
+  template <typename ForwardIt, typename RandomIt>
+  RandomIt find_left_batch(ForwardIt first, ForwardIt last,
+                           RandomIt out) const {
+    return find_batch_impl<left_tag>(first, last, out);
+  }
+
+  template <typename ForwardIt, typename RandomIt>
+  RandomIt find_right_batch(ForwardIt first, ForwardIt last,
+                            RandomIt out) const {
+    return find_batch_impl<right_tag>(first, last, out);
+  }
+
   // Возвращает противоположный элемент по элементу
   // Если элемента не существует -- бросает std::out_of_range
   right_t const& at_left(left_t const& key) const {
@@ -257,6 +743,18 @@ public:
     return at_impl<right_tag>(key);
   }
 
+  template <typename K, typename C = CompareLeft,
+            typename = typename C::is_transparent>
+  right_t const& at_left(K const& key) const {
+    return at_impl<left_tag>(key);
+  }
+
+  template <typename K, typename C = CompareRight,
+            typename = typename C::is_transparent>
+  left_t const& at_right(K const& key) const {
+    return at_impl<right_tag>(key);
+  }
+
   // Возвращает противоположный элемент по элементу
   // Если элемента не существует, добавляет его в bimap и на противоположную
   // сторону кладет дефолтный элемент, ссылку на который и возвращает
@@ -306,6 +804,83 @@ public:
     return tree<right_tag>().upper_bound(right);
   }
 
+  template <typename K, typename C = CompareLeft,
+            typename = typename C::is_transparent>
+  left_iterator lower_bound_left(const K& left) const {
+    return tree<left_tag>().lower_bound(left);
+  }
+
+  template <typename K, typename C = CompareLeft,
+            typename = typename C::is_transparent>
+  left_iterator upper_bound_left(const K& left) const {
+    return tree<left_tag>().upper_bound(left);
+  }
+
+  template <typename K, typename C = CompareRight,
+            typename = typename C::is_transparent>
+  right_iterator lower_bound_right(const K& right) const {
+    return tree<right_tag>().lower_bound(right);
+  }
+
+  template <typename K, typename C = CompareRight,
+            typename = typename C::is_transparent>
+  right_iterator upper_bound_right(const K& right) const {
+    return tree<right_tag>().upper_bound(right);
+  }
+
+  // Порядковые статистики по каждой стороне.
+  // nth возвращает итератор на k-й (с нуля) по порядку элемент или
+  // соответствующий end(), если k >= size().
+  left_iterator nth_left(size_t k) const {
+    return tree<left_tag>().nth(k);
+  }
+
+  right_iterator nth_right(size_t k) const {
+    return tree<right_tag>().nth(k);
+  }
+
+  // rank возвращает количество элементов, меньших key.
+  size_t rank_left(left_t const& key) const {
+    return tree<left_tag>().rank(key);
+  }
+
+  size_t rank_right(right_t const& key) const {
+    return tree<right_tag>().rank(key);
+  }
+
+  template <typename K, typename C = CompareLeft,
+            typename = typename C::is_transparent>
+  size_t rank_left(K const& key) const {
+    return tree<left_tag>().rank(key);
+  }
+
+  template <typename K, typename C = CompareRight,
+            typename = typename C::is_transparent>
+  size_t rank_right(K const& key) const {
+    return tree<right_tag>().rank(key);
+  }
+
+  // Количество элементов в полуинтервале [lo, hi).
+  size_t count_range_left(left_t const& lo, left_t const& hi) const {
+    return count_range_impl<left_tag>(lo, hi);
+  }
+
+  size_t count_range_right(right_t const& lo, right_t const& hi) const {
+    return count_range_impl<right_tag>(lo, hi);
+  }
+
+  template <typename K, typename C = CompareLeft,
+            typename = typename C::is_transparent>
+  size_t count_range_left(K const& lo, K const& hi) const {
+    return count_range_impl<left_tag>(lo, hi);
+  }
+
+  template <typename K, typename C = CompareRight,
+            typename = typename C::is_transparent>
+  size_t count_range_right(K const& lo, K const& hi) const {
+    return count_range_impl<right_tag>(lo, hi);
+  }
+
   // Возващает итератор на минимальный по порядку left.
   left_iterator begin_left() const {
     return begin_impl<left_tag>();
@@ -335,18 +910,24 @@ public:
   }
 
   // операторы сравнения
+  // Сравнивают пары в порядке left за один проход: обе половины пары берутся
+  // из одного узла, без flip().
   bool operator==(bimap const& other) const noexcept {
     if (size() != other.size()) {
       return false;
     }
+    if (this == &other) {
+      return true;
+    }
 
-    auto it_b = other.begin_left();
-    for (auto it_a = begin_left(); it_a != end_left(); ++it_a) {
-      if (!(*it_a == *it_b)) {
+    auto it_b = other.tree<left_tag>().begin();
+    for (auto const& a : tree<left_tag>()) {
+      auto const& b = *it_b;
+      if (!(a.template half<left_tag>() == b.template half<left_tag>())) {
         return false;
       }
 
-      if (!(*it_a.flip() == *it_b.flip())) {
+      if (!(a.template half<right_tag>() == b.template half<right_tag>())) {
         return false;
       }
 
@@ -360,21 +941,178 @@ public:
     return !(*this == other);
   }
 
+#ifdef BIMAP_STATS
+  // Статистика для диагностики, доступна только с BIMAP_STATS: счетчики
+  // сравнений, спусков по деревьям, split и merge для каждой стороны, число
+  // аллокаций и освобождений узлов, а также гистограммы глубин узлов.
+  // Гистограммы строятся обходом всех узлов, O(n).
+  bimap_impl::bimap_stats stats() const {
+    bimap_impl::bimap_stats result;
+    result.left = tree<left_tag>().stats();
+    result.right = tree<right_tag>().stats();
+    result.allocations = allocations.load();
+    result.deallocations = deallocations.load();
+    return result;
+  }
+
+  void reset_stats() noexcept {
+    tree<left_tag>().reset_stats();
+    tree<right_tag>().reset_stats();
+    allocations.reset();
+    deallocations.reset();
+  }
+#endif
+
+  // Копирует пары в неизменяемый frozen_bimap с теми же компараторами.
+  // Бросает std::length_error, если пар больше, чем 2^32 - 1.
+  frozen_bimap<Left, Right, CompareLeft, CompareRight> freeze() const {
+    static_assert(bimap_impl::has_subtree_sizes<SizePolicy>,
+                  "freeze needs subtree sizes to find partner positions");
+    return frozen_bimap<Left, Right, CompareLeft, CompareRight>(
+        *this, tree<left_tag>().key_comp(), tree<right_tag>().key_comp());
+  }
+
 private:
   template <typename Tag>
   auto erase_impl(iterator_impl<Tag> it) {
     auto next_it = it;
     ++next_it;
 
-    tree<typename traits<Tag>::opposite::tag>().erase(*it.flip());
-    tree<Tag>().erase(*it);
+    tree<typename traits<Tag>::opposite::tag>().erase(*it.cur);
+    tree<Tag>().erase(*it.cur);
 
-    const binode_t& node = *it.cur;
-    delete &node;
+    destroy_node(*it.cur);
 
     return next_it;
   }
 
+  using left_position_t = typename left_tree_t::found;
+  using right_position_t = typename right_tree_t::found;
+
+  // Positions come from locate on the current trees and have no node.
+  left_iterator link_at(const left_position_t& left_position,
+                        const right_position_t& right_position,
+                        binode_t& node) noexcept {
+    tree<left_tag>().insert(left_position, node);
+    tree<right_tag>().insert(right_position, node);
+    return node;
+  }
+
+  template <typename Tag, typename Key, typename... Args>
+  left_iterator try_emplace_impl(Key&& key, Args&&... args) {
+    using opposite_tag = typename traits<Tag>::opposite::tag;
+
+    auto position = tree<Tag>().locate(key);
+    if (position.child) {
+      return end_left();
+    }
+
+    binode_t* b;
+    if constexpr (std::is_same_v<Tag, left_tag>) {
+      b = create_node(std::piecewise_construct,
+                      std::forward_as_tuple(std::forward<Key>(key)),
+                      std::forward_as_tuple(std::forward<Args>(args)...),
+                      rand_rank());
+    } else {
+      b = create_node(std::piecewise_construct,
+                      std::forward_as_tuple(std::forward<Args>(args)...),
+                      std::forward_as_tuple(std::forward<Key>(key)),
+                      rand_rank());
+    }
+
+    auto opposite_position =
+        tree<opposite_tag>().locate(b->template half<opposite_tag>());
+    if (opposite_position.child) {
+      destroy_node(*b);
+      return end_left();
+    }
+
+    if constexpr (std::is_same_v<Tag, left_tag>) {
+      return link_at(position, opposite_position, *b);
+    } else {
+      return link_at(opposite_position, position, *b);
+    }
+  }
+
+  template <typename Tag>
+  node_type extract_impl(iterator_impl<Tag> it) {
+    auto& node = const_cast<binode_t&>(*it.cur);
+    tree<left_tag>().erase(node);
+    tree<right_tag>().erase(node);
+
+    return node_type(&node, node_allocator());
+  }
+
+  // Only the Tag tree is relinked, at the position of the single descent
+  // that checks value for a conflict.
+  template <typename Tag, typename Half>
+  bool replace_impl(const binode_t& target, Half value) {
+    using opposite_tag = typename traits<Tag>::opposite::tag;
+
+    auto position = tree<Tag>().locate(value);
+    if (position.child && position.child != &target.template as_node<Tag>()) {
+      return false;
+    }
+
+    auto& node = const_cast<binode_t&>(target);
+    try {
+      tree<Tag>().replace_key(node, position,
+                              [&](auto& key) { key = std::move(value); });
+    } catch (...) {
+      tree<opposite_tag>().erase(node);
+      destroy_node(node);
+      throw;
+    }
+
+    return true;
+  }
+
+  template <typename Tag>
+  bimap extract_range_impl(iterator_impl<Tag> first, iterator_impl<Tag> last) {
+    using opposite_tag = typename traits<Tag>::opposite::tag;
+
+    bimap result(tree<left_tag>().key_comp(), tree<right_tag>().key_comp(),
+                 get_allocator());
+    tree<Tag>().split_off(first.cur, last.cur, result.tree<Tag>());
+
+    auto& extracted = result.tree<Tag>();
+    for (auto it = extracted.begin(); it != extracted.end(); ++it) {
+      tree<opposite_tag>().erase(*it);
+      result.tree<opposite_tag>().insert(const_cast<binode_t&>(*it));
+    }
+
+    return result;
+  }
+
+  template <typename Executor>
+  void filter_impl(bimap const& other, bool remove_matched,
+                   const Executor& executor) {
+    if (&other == this) {
+      if (remove_matched) {
+        erase_left(begin_left(), end_left());
+      }
+      return;
+    }
+
+    auto compare_right = tree<right_tag>().key_comp();
+    auto same_right = [&](const binode_t& a, const binode_t& b) {
+      const auto& a_right = a.template half<right_tag>();
+      const auto& b_right = b.template half<right_tag>();
+      return !compare_right(a_right, b_right) &&
+             !compare_right(b_right, a_right);
+    };
+
+    tree<left_tag>().filter(
+        other.tree<left_tag>(), remove_matched, executor,
+        [&](const binode_t& node, const binode_t& match) {
+          return same_right(node, match) != remove_matched;
+        },
+        [&](binode_t& node) {
+          tree<right_tag>().erase(node);
+          destroy_node(node);
+        });
+  }
+
   template <typename Tag, typename Half>
   bool erase_impl(const Half& value) {
     auto it = find_impl<Tag>(value);
@@ -398,11 +1136,185 @@ private:
     return last;
   }
 
+  // Copies both trees of other node for node, keeping their shapes, in
+  // linear expected time and without comparing keys. The walk over the left
+  // tree records the copy of every node, the walk over the right tree links
+  // the same copies. other is only read.
+  // Must be called on an empty bimap.
+  void clone(const bimap& other) {
+    bimap_impl::copy_table<binode_t> copies(other.size());
+    tree<left_tag>().clone(
+        other.tree<left_tag>(),
+        [&](const binode_t& node) -> binode_t& {
+          auto* copy = create_node(node.template half<left_tag>(),
+                                   node.template half<right_tag>(), node.rank);
+          copies.add(node, *copy);
+          return *copy;
+        },
+        [this](binode_t& node) { destroy_node(node); });
+    tree<right_tag>().clone(
+        other.tree<right_tag>(),
+        [&](const binode_t& node) -> binode_t& { return copies.find(node); },
+        [](binode_t&) {});
+  }
+
+  // Must be called on an empty bimap.
+  template <typename InputIt>
+  void build_sorted(InputIt first, InputIt last) {
+    build(create_nodes(first, last), true, nullptr,
+          bimap_impl::sequential_executor());
+  }
+
+  // Creates nodes for the pairs in input order.
+  template <typename InputIt>
+  std::vector<binode_t*> create_nodes(InputIt first, InputIt last) {
+    std::vector<binode_t*> nodes;
+
+    try {
+      for (; first != last; ++first) {
+        auto&& pair = *first;
+        nodes.push_back(nullptr);
+        nodes.back() =
+            create_node(std::forward<decltype(pair)>(pair).first,
+                        std::forward<decltype(pair)>(pair).second, rand_rank());
+      }
+    } catch (...) {
+      destroy_nodes(nodes);
+      throw;
+    }
+
+    return nodes;
+  }
+
+  void destroy_nodes(const std::vector<binode_t*>& nodes) noexcept {
+    for (auto* node : nodes) {
+      if (node) {
+        destroy_node(*node);
+      }
+    }
+  }
+
+  // Builds both trees of this empty bimap from the nodes that inserting them
+  // one by one in the given order would keep, skipping also the pairs that
+  // conflict with existing. Takes ownership of all the nodes.
+  template <typename Executor>
+  void build(std::vector<binode_t*> nodes, bool sorted_by_left,
+             const bimap* existing, const Executor& executor) {
+    std::vector<binode_t*> by_left;
+    std::vector<binode_t*> by_right;
+    std::vector<char> accepted(nodes.size(), true);
+
+    try {
+      auto left_order = sorted_order<left_tag>(nodes, !sorted_by_left, executor);
+      auto right_order = sorted_order<right_tag>(nodes, true, executor);
+      auto left_group = number_groups<left_tag>(nodes, left_order);
+      auto right_group = number_groups<right_tag>(nodes, right_order);
+
+      if (existing) {
+        bimap_impl::parallel_for(0, nodes.size(), executor, [&](size_t i) {
+          accepted[i] =
+              existing->find_left(nodes[i]->template half<left_tag>()) ==
+                  existing->end_left() &&
+              existing->find_right(nodes[i]->template half<right_tag>()) ==
+                  existing->end_right();
+        });
+      }
+
+      // replays the sequence of inserts: a pair is taken unless its left or
+      // its right is already taken
+      std::vector<bool> left_taken(nodes.size(), false);
+      std::vector<bool> right_taken(nodes.size(), false);
+      for (size_t i = 0; i < nodes.size(); ++i) {
+        if (!accepted[i] || left_taken[left_group[i]] ||
+            right_taken[right_group[i]]) {
+          accepted[i] = false;
+          continue;
+        }
+
+        left_taken[left_group[i]] = true;
+        right_taken[right_group[i]] = true;
+      }
+
+      by_left.reserve(nodes.size());
+      by_right.reserve(nodes.size());
+      for (size_t i = 0; i < nodes.size(); ++i) {
+        if (accepted[left_order[i]]) {
+          by_left.push_back(nodes[left_order[i]]);
+        }
+        if (accepted[right_order[i]]) {
+          by_right.push_back(nodes[right_order[i]]);
+        }
+      }
+    } catch (...) {
+      destroy_nodes(nodes);
+      throw;
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      if (!accepted[i]) {
+        destroy_node(*nodes[i]);
+      }
+    }
+
+    tree<left_tag>().assign_sorted(by_left.begin(), by_left.end());
+    tree<right_tag>().assign_sorted(by_right.begin(), by_right.end());
+  }
+
+  // Indices of nodes ordered (stably) by the Tag half, if sort is set.
+  template <typename Tag, typename Executor>
+  std::vector<size_t> sorted_order(const std::vector<binode_t*>& nodes,
+                                   bool sort, const Executor& executor) const {
+    std::vector<size_t> order(nodes.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    if (sort) {
+      auto compare = tree<Tag>().key_comp();
+      bimap_impl::parallel_stable_sort(
+          order.begin(), order.end(),
+          [&](size_t a, size_t b) {
+            return compare(nodes[a]->template half<Tag>(),
+                           nodes[b]->template half<Tag>());
+          },
+          executor);
+    }
+
+    return order;
+  }
+
+  // group[i] numbers the distinct Tag half of i-th node.
+  template <typename Tag>
+  std::vector<size_t> number_groups(const std::vector<binode_t*>& nodes,
+                                    const std::vector<size_t>& order) const {
+    auto compare = tree<Tag>().key_comp();
+    std::vector<size_t> group(nodes.size());
+
+    for (size_t i = 0, cur_group = 0; i < order.size(); ++i) {
+      if (i != 0 && compare(nodes[order[i - 1]]->template half<Tag>(),
+                            nodes[order[i]]->template half<Tag>())) {
+        ++cur_group;
+      }
+      group[order[i]] = cur_group;
+    }
+
+    return group;
+  }
+
   template <typename Tag, typename Half>
   auto find_impl(const Half& value) const noexcept {
     return iterator_impl<Tag>(tree<Tag>().find(value));
   }
 
+  template <typename Tag, typename ForwardIt, typename RandomIt>
+  RandomIt find_batch_impl(ForwardIt first, ForwardIt last,
+                           RandomIt out) const {
+    using tree_iterator_t = typename traits<Tag>::half_tree_iterator_t;
+
+    size_t count = tree<Tag>().find_batch(
+        first, last,
+        [&](size_t i, tree_iterator_t it) { out[i] = iterator_impl<Tag>(it); });
+    return out + count;
+  }
+
   template <typename Tag, typename Half>
   const auto& at_impl(const Half& key) const {
     auto it = find_impl<Tag>(key);
@@ -413,6 +1325,13 @@ private:
     }
   }
 
+  template <typename Tag, typename Half>
+  size_t count_range_impl(const Half& lo, const Half& hi) const {
+    size_t lo_rank = tree<Tag>().rank(lo);
+    size_t hi_rank = tree<Tag>().rank(hi);
+    return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+  }
+
   template <typename Tag>
   auto begin_impl() const {
     return tree<Tag>().begin();
@@ -423,6 +1342,47 @@ private:
     return tree<Tag>().end();
   }
 
+  template <typename... Args>
+  binode_t* create_node(Args&&... args) {
+    auto& alloc = node_allocator();
+    binode_t* node = node_allocator_traits_t::allocate(alloc, 1);
+#ifdef BIMAP_STATS
+    allocations.add();
+#endif
+
+    try {
+      node_allocator_traits_t::construct(alloc, node,
+                                         std::forward<Args>(args)...);
+    } catch (...) {
+      node_allocator_traits_t::deallocate(alloc, node, 1);
+#ifdef BIMAP_STATS
+      deallocations.add();
+#endif
+      throw;
+    }
+
+    return node;
+  }
+
+  void destroy_node(const binode_t& node) noexcept {
+    auto& alloc = node_allocator();
+    auto* ptr = const_cast<binode_t*>(&node);
+
+    node_allocator_traits_t::destroy(alloc, ptr);
+    node_allocator_traits_t::deallocate(alloc, ptr, 1);
+#ifdef BIMAP_STATS
+    deallocations.add();
+#endif
+  }
+
+  node_allocator_t& node_allocator() noexcept {
+    return static_cast<node_allocator_t&>(trees);
+  }
+
+  const node_allocator_t& node_allocator() const noexcept {
+    return static_cast<const node_allocator_t&>(trees);
+  }
+
   template <typename Tag>
   auto& tree() noexcept {
     return static_cast<typename traits<Tag>::half_tree_t&>(trees);
@@ -434,5 +1394,9 @@ private:
   }
 
   tree_pair trees;
-  std::mt19937 rand_rank{std::random_device{}()};
+  bimap_impl::priority_source rand_rank{static_cast<const void*>(this)};
+#ifdef BIMAP_STATS
+  bimap_impl::stat_counter allocations;
+  bimap_impl::stat_counter deallocations;
+#endif
 };
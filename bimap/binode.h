@@ -1,24 +1,51 @@
 #pragma once
 
+#include <tuple>
+#include <utility>
+
 #include "treap.h"
 
 namespace bimap_impl {
 struct left_tag;
 struct right_tag;
 
-template <typename Left, typename Right>
-struct binode : node<Left, left_tag>, node<Right, right_tag> {
-  binode(Left left, Right right, size_t rank) noexcept
-      : node<Left, left_tag>(std::move(left), rank), node<Right, right_tag>(
-                                                         std::move(right),
-                                                         rank) {}
+template <typename Left, typename Right,
+          typename SizePolicy = subtree_sizes<size_t>>
+struct binode : node<Left, left_tag, SizePolicy>,
+                node<Right, right_tag, SizePolicy> {
+  using left_node_t = node<Left, left_tag, SizePolicy>;
+  using right_node_t = node<Right, right_tag, SizePolicy>;
+
+  template <typename L, typename R>
+  binode(L&& left, R&& right, uint32_t rank)
+      : binode(std::piecewise_construct,
+               std::forward_as_tuple(std::forward<L>(left)),
+               std::forward_as_tuple(std::forward<R>(right)), rank) {}
+
+  // Constructs both halves in place, as the constructor of std::pair does.
+  template <typename LeftArgs, typename RightArgs>
+  binode(std::piecewise_construct_t, LeftArgs&& left, RightArgs&& right,
+         uint32_t rank)
+      : left_node_t(std::piecewise_construct, std::forward<LeftArgs>(left)),
+        right_node_t(std::piecewise_construct,
+                     std::forward<RightArgs>(right)),
+        rank(rank) {}
 
   template <typename Tag>
   const auto& as_node() const noexcept {
     if constexpr (std::is_same_v<Tag, left_tag>) {
-      return static_cast<const node<Left, left_tag>&>(*this);
+      return static_cast<const left_node_t&>(*this);
+    } else {
+      return static_cast<const right_node_t&>(*this);
+    }
+  }
+
+  template <typename Tag>
+  auto& as_node() noexcept {
+    if constexpr (std::is_same_v<Tag, left_tag>) {
+      return static_cast<left_node_t&>(*this);
     } else {
-      return static_cast<const node<Right, right_tag>&>(*this);
+      return static_cast<right_node_t&>(*this);
     }
   }
 
@@ -26,5 +53,15 @@ struct binode : node<Left, left_tag>, node<Right, right_tag> {
   const auto& half() const noexcept {
     return as_node<Tag>().key;
   }
+
+  template <typename Tag>
+  auto& half() noexcept {
+    return as_node<Tag>().key;
+  }
+
+  // Priority of the pair in both treaps. Sharing it keeps the two trees
+  // independent while saving a word per side, and being last lets it take
+  // the tail padding of the right half.
+  const uint32_t rank;
 };
 } // namespace bimap_impl
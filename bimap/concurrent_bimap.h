@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include "binode.h"
+#include "epoch.h"
+#include "persistent_bimap.h"
+#include "persistent_treap.h"
+
+// bimap для одного писателя и многих читателей. Пары хранятся в двух
+// персистентных декартовых деревьях (left -> right и right -> left), текущая
+// версия публикуется атомарным указателем. Читатели не берут блокировок и не
+// ждут: find, at и contains работают по снимку, который был текущим в момент
+// вызова. Писатели сериализуются мьютексом и копируют только путь до
+// изменяемого ключа. Замененные версии откладываются и освобождаются
+// следующими записями, когда их читатели уже закончили, поэтому писатель не
+// ждет читателей; ждать приходится, только если отложенных версий
+// накопилось больше retired_limit.
+// Ключи хранятся в обоих деревьях, поэтому Left и Right должны копироваться.
+// Возвращаются копии значений: ссылки в узлы не переживали бы удаление.
+template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+class concurrent_bimap {
+  using left_tree_t = bimap_impl::persistent_treap<Left, Right, CompareLeft>;
+  using right_tree_t = bimap_impl::persistent_treap<Right, Left, CompareRight>;
+
+  struct version {
+    left_tree_t lefts;
+    right_tree_t rights;
+
+    // list of retired versions, oldest first
+    version* next_retired = nullptr;
+    size_t retired_epoch = 0;
+  };
+
+public:
+  using left_t = Left;
+  using right_t = Right;
+
+  concurrent_bimap(CompareLeft compare_left = CompareLeft(),
+                   CompareRight compare_right = CompareRight())
+      : current(new version{left_tree_t(std::move(compare_left)),
+                            right_tree_t(std::move(compare_right))}) {}
+
+  static constexpr size_t retired_limit = 64;
+
+  concurrent_bimap(concurrent_bimap const& other) = delete;
+  concurrent_bimap& operator=(concurrent_bimap const& other) = delete;
+
+  // Читателей в момент разрушения быть не должно.
+  ~concurrent_bimap() {
+    free_retired(true);
+    delete current.load();
+  }
+
+  // Вставка пары (left, right). Если такой left или такой right уже
+  // присутствуют, вставка не производится и возвращается false.
+  bool insert(left_t left, right_t right) {
+    std::lock_guard<std::mutex> lock(writer);
+    const version* old = current.load();
+    if (old->lefts.find(left) || old->rights.find(right)) {
+      return false;
+    }
+
+    auto next = std::make_unique<version>(version{old->lefts, old->rights});
+    uint32_t rank = rand_rank();
+    next->lefts.insert(left, right, rank);
+    next->rights.insert(std::move(right), std::move(left), rank);
+    publish(std::move(next));
+    return true;
+  }
+
+  // Удаляет пару по ключу, возвращает была ли пара удалена.
+  bool erase_left(left_t const& left) {
+    std::lock_guard<std::mutex> lock(writer);
+    const version* old = current.load();
+    auto* node = old->lefts.find(left);
+    if (!node) {
+      return false;
+    }
+
+    auto next = std::make_unique<version>(version{old->lefts, old->rights});
+    next->rights.erase(node->mapped);
+    next->lefts.erase(left);
+    publish(std::move(next));
+    return true;
+  }
+
+  bool erase_right(right_t const& right) {
+    std::lock_guard<std::mutex> lock(writer);
+    const version* old = current.load();
+    auto* node = old->rights.find(right);
+    if (!node) {
+      return false;
+    }
+
+    auto next = std::make_unique<version>(version{old->lefts, old->rights});
+    next->lefts.erase(node->mapped);
+    next->rights.erase(right);
+    publish(std::move(next));
+    return true;
+  }
+
+  // Возвращает противоположный элемент, если он есть.
+  std::optional<right_t> find_left(left_t const& left) const {
+    auto guard = epoch.enter();
+    auto* node = current.load()->lefts.find(left);
+    return node ? std::optional<right_t>(node->mapped) : std::nullopt;
+  }
+
+  std::optional<left_t> find_right(right_t const& right) const {
+    auto guard = epoch.enter();
+    auto* node = current.load()->rights.find(right);
+    return node ? std::optional<left_t>(node->mapped) : std::nullopt;
+  }
+
+  // Возвращает противоположный элемент по элементу
+  // Если элемента не существует -- бросает std::out_of_range
+  right_t at_left(left_t const& key) const {
+    auto found = find_left(key);
+    if (!found) {
+      throw std::out_of_range("concurrent_bimap: out of range");
+    }
+
+    return std::move(*found);
+  }
+
+  left_t at_right(right_t const& key) const {
+    auto found = find_right(key);
+    if (!found) {
+      throw std::out_of_range("concurrent_bimap: out of range");
+    }
+
+    return std::move(*found);
+  }
+
+  bool contains_left(left_t const& left) const {
+    auto guard = epoch.enter();
+    return current.load()->lefts.find(left) != nullptr;
+  }
+
+  bool contains_right(right_t const& right) const {
+    auto guard = epoch.enter();
+    return current.load()->rights.find(right) != nullptr;
+  }
+
+  // Снимок текущего содержимого за O(1): узлы разделяются со снимком, и
+  // дальнейшие изменения его не затрагивают.
+  persistent_bimap<Left, Right, CompareLeft, CompareRight> snapshot() const {
+    auto guard = epoch.enter();
+    const version* v = current.load();
+    return {v->lefts, v->rights};
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  size_t size() const noexcept {
+    auto guard = epoch.enter();
+    return current.load()->lefts.size();
+  }
+
+private:
+  // The old version is retired with the current epoch, and the retired
+  // versions no reader can reach any more are freed together with the
+  // nodes only they refer to. Only a writer that finds too many retired
+  // versions waits for readers.
+  void publish(std::unique_ptr<version> next) noexcept {
+    version* old = current.exchange(next.release());
+    old->retired_epoch = epoch.current();
+    if (retired_tail) {
+      retired_tail->next_retired = old;
+    } else {
+      retired_head = old;
+    }
+    retired_tail = old;
+    ++retired_count;
+
+    if (retired_count > retired_limit) {
+      epoch.synchronize();
+      free_retired(true);
+    } else {
+      epoch.try_advance();
+      free_retired(false);
+    }
+  }
+
+  // Frees the reclaimable retired versions, or all of them.
+  void free_retired(bool all) noexcept {
+    while (retired_head &&
+           (all || epoch.reclaimable(retired_head->retired_epoch))) {
+      std::unique_ptr<version> freed(retired_head);
+      retired_head = freed->next_retired;
+      --retired_count;
+    }
+
+    if (!retired_head) {
+      retired_tail = nullptr;
+    }
+  }
+
+  std::atomic<version*> current;
+  bimap_impl::epoch_domain epoch;
+  std::mutex writer;
+  version* retired_head = nullptr;
+  version* retired_tail = nullptr;
+  size_t retired_count = 0;
+  bimap_impl::priority_source rand_rank{static_cast<const void*>(this)};
+};
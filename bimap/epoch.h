@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+
+namespace bimap_impl {
+// Grace periods for read-mostly structures. Readers announce themselves in
+// one of two counters selected by the parity of the epoch they entered in
+// and never wait. The epoch moves from e to e + 1 only once no reader of
+// e - 1 is left, so the readers inside are always from the current epoch or
+// the one before. Memory unlinked in epoch e is thus unreachable once the
+// epoch is e + 2: a writer can retire it with the current epoch and free it
+// after later calls to try_advance(), without waiting for readers, or wait
+// in synchronize().
+// Counters are striped by thread over separate cache lines, so readers on
+// different cores rarely share one.
+// The epoch is moved by one thread at a time.
+class epoch_domain {
+  static constexpr size_t stripes_count = 32;
+
+  struct alignas(64) stripe {
+    std::atomic<size_t> readers[2] = {};
+  };
+
+public:
+  class guard {
+  public:
+    guard(guard const& other) = delete;
+    guard& operator=(guard const& other) = delete;
+
+    ~guard() {
+      counter->fetch_sub(1, std::memory_order_release);
+    }
+
+  private:
+    friend epoch_domain;
+
+    explicit guard(std::atomic<size_t>* counter) noexcept : counter(counter) {}
+
+    std::atomic<size_t>* counter;
+  };
+
+  epoch_domain() noexcept = default;
+
+  epoch_domain(epoch_domain const& other) = delete;
+  epoch_domain& operator=(epoch_domain const& other) = delete;
+
+  // Opens a read-side critical section that lasts until the guard is
+  // destroyed.
+  guard enter() const noexcept {
+    auto& s = stripes[stripe_index()];
+    for (;;) {
+      size_t e = epoch.load();
+      s.readers[e & 1].fetch_add(1);
+      if (epoch.load() == e) {
+        return guard(&s.readers[e & 1]);
+      }
+      s.readers[e & 1].fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  size_t current() const noexcept {
+    return epoch.load();
+  }
+
+  // Whether memory retired in epoch retired can be freed.
+  bool reclaimable(size_t retired) const noexcept {
+    return current() >= retired + 2;
+  }
+
+  // Moves the epoch on if the readers of the previous one are gone, never
+  // waits. Returns whether it moved.
+  bool try_advance() noexcept {
+    size_t e = epoch.load();
+    if (!drained((e - 1) & 1)) {
+      return false;
+    }
+
+    epoch.store(e + 1);
+    return true;
+  }
+
+  // Waits until no reader can still hold a pointer read before the call.
+  void synchronize() noexcept {
+    for (int i = 0; i < 2; ++i) {
+      while (!try_advance()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  bool drained(size_t parity) const noexcept {
+    for (auto& s : stripes) {
+      if (s.readers[parity].load(std::memory_order_acquire) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static size_t stripe_index() noexcept {
+    thread_local size_t index =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) %
+        stripes_count;
+    return index;
+  }
+
+  mutable stripe stripes[stripes_count];
+  std::atomic<size_t> epoch{0};
+};
+} // namespace bimap_impl
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <thread>
+
+namespace bimap_impl {
+// Executors run the two halves of a divide-and-conquer step. concurrency()
+// tells how many ways the work is worth splitting.
+struct sequential_executor {
+  size_t concurrency() const noexcept {
+    return 1;
+  }
+
+  template <typename F, typename G>
+  void fork_join(F&& f, G&& g) const {
+    f();
+    g();
+  }
+};
+
+// Runs the first half on a new thread (std::async) and the second one on the
+// calling thread. If a thread cannot be started or its shared state cannot
+// be allocated, both run sequentially, so fork_join throws only what f and g
+// throw: treaps call it from noexcept set operations.
+class thread_executor {
+public:
+  explicit thread_executor(size_t threads = std::thread::hardware_concurrency())
+      : threads(threads == 0 ? 1 : threads) {}
+
+  size_t concurrency() const noexcept {
+    return threads;
+  }
+
+  template <typename F, typename G>
+  void fork_join(F&& f, G&& g) const {
+    std::future<void> forked;
+    try {
+      forked = std::async(std::launch::async, [&f] { f(); });
+    } catch (...) {
+      f();
+      g();
+      return;
+    }
+
+    g();
+    forked.get();
+  }
+
+private:
+  size_t threads;
+};
+
+// Below this many elements a step is never split between threads.
+constexpr size_t parallel_grain = size_t(1) << 12;
+
+// Splits work of the given size between parallelism workers: f and g get the
+// share of parallelism they may use further.
+template <typename Executor, typename F, typename G>
+void fork(const Executor& executor, size_t parallelism, size_t size, F&& f,
+          G&& g) {
+  if (parallelism > 1 && size >= parallel_grain) {
+    executor.fork_join([&] { f(parallelism / 2); },
+                       [&] { g(parallelism - parallelism / 2); });
+  } else {
+    f(1);
+    g(1);
+  }
+}
+
+template <typename Executor, typename F>
+void parallel_for(size_t first, size_t last, const Executor& executor, F&& f,
+                  size_t parallelism) {
+  if (parallelism <= 1 || last - first < parallel_grain) {
+    for (; first != last; ++first) {
+      f(first);
+    }
+    return;
+  }
+
+  size_t middle = first + (last - first) / 2;
+  fork(executor, parallelism, last - first,
+       [&](size_t p) { parallel_for(first, middle, executor, f, p); },
+       [&](size_t p) { parallel_for(middle, last, executor, f, p); });
+}
+
+template <typename Executor, typename F>
+void parallel_for(size_t first, size_t last, const Executor& executor, F&& f) {
+  parallel_for(first, last, executor, f, executor.concurrency());
+}
+
+template <typename RandomIt, typename Compare, typename Executor>
+void parallel_stable_sort(RandomIt first, RandomIt last, Compare&& compare,
+                          const Executor& executor, size_t parallelism) {
+  if (parallelism <= 1 || size_t(last - first) < parallel_grain) {
+    std::stable_sort(first, last, compare);
+    return;
+  }
+
+  auto middle = first + (last - first) / 2;
+  fork(executor, parallelism, last - first,
+       [&](size_t p) {
+         parallel_stable_sort(first, middle, compare, executor, p);
+       },
+       [&](size_t p) {
+         parallel_stable_sort(middle, last, compare, executor, p);
+       });
+  std::inplace_merge(first, middle, last, compare);
+}
+
+template <typename RandomIt, typename Compare, typename Executor>
+void parallel_stable_sort(RandomIt first, RandomIt last, Compare&& compare,
+                          const Executor& executor) {
+  parallel_stable_sort(first, last, compare, executor,
+                       executor.concurrency());
+}
+} // namespace bimap_impl
@@ -0,0 +1,627 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sorted_search.h"
+
+namespace bimap_impl {
+struct left_tag;
+struct right_tag;
+
+// A flat side keeps the summary of its cache-line blocks up to date on every
+// change, which must not throw halfway: keys whose copies may throw are
+// searched with a plain binary search instead.
+template <typename Key>
+constexpr bool flat_blocked = std::is_nothrow_copy_constructible_v<Key> &&
+                              std::is_nothrow_copy_assignable_v<Key>;
+} // namespace bimap_impl
+
+// bimap с тем же интерфейсом, что и у bimap, но хранящий каждую сторону
+// отсортированным непрерывным массивом. Пара связана индексами: у каждого
+// элемента стороны хранится позиция его пары на противоположной стороне.
+//
+// Ключи каждой стороны выровнены по кэш-линии и разбиты на блоки размером
+// не больше кэш-линии, как во frozen_bimap: поиск -- бинарный поиск по
+// массиву последних ключей блоков и просмотр одного блока (для целых ключей
+// с std::less -- SIMD-сравнениями). Блок совпадает с кэш-линией, если
+// sizeof ключа делит ее размер, иначе может задевать две линии. Ключи,
+// копирование которых может бросить исключение, ищутся обычным бинарным
+// поиском без ветвлений. Итераторы произвольного доступа работают за O(1).
+//
+// Вставка и удаление работают за O(n): они сдвигают массивы ключей и индексов
+// обеих сторон, перенумеровывают индексы пар и обновляют последние ключи
+// блоков после измененной позиции. Поэтому структура подходит для bimap,
+// которые в основном читаются.
+// Любая вставка или удаление инвалидирует все итераторы.
+template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+class flat_bimap {
+public:
+  using left_tag = bimap_impl::left_tag;
+  using right_tag = bimap_impl::right_tag;
+
+  template <typename Key, typename Compare, typename Tag>
+  struct side : Compare {
+    explicit side(Compare compare) : Compare(std::move(compare)) {}
+
+    std::vector<Key, bimap_impl::cache_aligned_allocator<Key>> keys;
+    // index of the other half of the pair on the opposite side
+    std::vector<size_t> partner;
+    // last key of every cache-line block of keys, kept only for flat_blocked
+    // keys, see block_lower_bound
+    std::vector<Key> summary;
+  };
+
+  template <typename Tag, typename = void>
+  struct traits;
+
+  template <typename Dummy>
+  struct traits<left_tag, Dummy> {
+    using opposite = traits<right_tag>;
+    using tag = left_tag;
+    using half_t = Left;
+    using compare_half_t = CompareLeft;
+    using side_t = side<Left, CompareLeft, left_tag>;
+  };
+
+  template <typename Dummy>
+  struct traits<right_tag, Dummy> {
+    using opposite = traits<left_tag>;
+    using tag = right_tag;
+    using half_t = Right;
+    using compare_half_t = CompareRight;
+    using side_t = side<Right, CompareRight, right_tag>;
+  };
+
+  using left_t = Left;
+  using right_t = Right;
+
+  struct side_pair : traits<left_tag>::side_t, traits<right_tag>::side_t {
+    side_pair(CompareLeft compare_left, CompareRight compare_right)
+        : traits<left_tag>::side_t(std::move(compare_left)),
+          traits<right_tag>::side_t(std::move(compare_right)) {}
+  };
+
+  template <typename Tag>
+  class iterator_impl {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = typename traits<Tag>::half_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    iterator_impl() noexcept = default;
+
+    value_type const& operator*() const {
+      return map->template side_of<Tag>().keys[index];
+    }
+
+    value_type const* operator->() const {
+      return &**this;
+    }
+
+    iterator_impl& operator++() {
+      ++index;
+      return *this;
+    }
+
+    iterator_impl operator++(int) {
+      auto copy = *this;
+      ++index;
+      return copy;
+    }
+
+    iterator_impl& operator--() {
+      --index;
+      return *this;
+    }
+
+    iterator_impl operator--(int) {
+      auto copy = *this;
+      --index;
+      return copy;
+    }
+
+    iterator_impl& operator+=(difference_type n) {
+      index += n;
+      return *this;
+    }
+
+    iterator_impl& operator-=(difference_type n) {
+      index -= n;
+      return *this;
+    }
+
+    iterator_impl operator+(difference_type n) const {
+      return {map, index + n};
+    }
+
+    friend iterator_impl operator+(difference_type n, const iterator_impl& it) {
+      return it + n;
+    }
+
+    iterator_impl operator-(difference_type n) const {
+      return {map, index - n};
+    }
+
+    difference_type operator-(const iterator_impl& other) const {
+      return static_cast<difference_type>(index) -
+             static_cast<difference_type>(other.index);
+    }
+
+    value_type const& operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    // Итератор на противоположный элемент той же пары, end() переходит в
+    // end() противоположной стороны.
+    iterator_impl<typename traits<Tag>::opposite::tag> flip() const {
+      auto& partner = map->template side_of<Tag>().partner;
+      return {map, index < partner.size() ? partner[index] : partner.size()};
+    }
+
+    bool operator==(const iterator_impl& other) const noexcept {
+      return map == other.map && index == other.index;
+    }
+
+    bool operator!=(const iterator_impl& other) const noexcept {
+      return !(*this == other);
+    }
+
+    bool operator<(const iterator_impl& other) const noexcept {
+      return index < other.index;
+    }
+
+    bool operator>(const iterator_impl& other) const noexcept {
+      return other < *this;
+    }
+
+    bool operator<=(const iterator_impl& other) const noexcept {
+      return !(other < *this);
+    }
+
+    bool operator>=(const iterator_impl& other) const noexcept {
+      return !(*this < other);
+    }
+
+    friend flat_bimap;
+
+  private:
+    iterator_impl(const flat_bimap* map, size_t index) noexcept
+        : map(map), index(index) {}
+
+    const flat_bimap* map = nullptr;
+    size_t index = 0;
+  };
+
+  using left_iterator = iterator_impl<left_tag>;
+  using right_iterator = iterator_impl<right_tag>;
+
+  flat_bimap(CompareLeft compare_left = CompareLeft(),
+             CompareRight compare_right = CompareRight())
+      : sides(std::move(compare_left), std::move(compare_right)) {}
+
+  flat_bimap(flat_bimap const& other) = default;
+  flat_bimap(flat_bimap&& other) noexcept = default;
+
+  flat_bimap& operator=(flat_bimap const& other) = default;
+  flat_bimap& operator=(flat_bimap&& other) noexcept = default;
+
+  void swap(flat_bimap& other) noexcept {
+    std::swap(sides, other.sides);
+  }
+
+  // Вставка пары (left, right), возвращает итератор на left.
+  // Если такой left или такой right уже присутствуют, вставка не
+  // производится и возвращается end_left(). Работает за O(n).
+  left_iterator insert(left_t left, right_t right) {
+    size_t l = lower_bound_index<left_tag>(left);
+    if (contains_at<left_tag>(l, left)) {
+      return end_left();
+    }
+
+    size_t r = lower_bound_index<right_tag>(right);
+    if (contains_at<right_tag>(r, right)) {
+      return end_left();
+    }
+
+    auto& lhs = side_of<left_tag>();
+    auto& rhs = side_of<right_tag>();
+    reserve(size() + 1);
+
+    lhs.keys.insert(lhs.keys.begin() + l, std::move(left));
+    try {
+      rhs.keys.insert(rhs.keys.begin() + r, std::move(right));
+    } catch (...) {
+      lhs.keys.erase(lhs.keys.begin() + l);
+      throw;
+    }
+
+    for (auto& p : lhs.partner) {
+      p += p >= r;
+    }
+    for (auto& p : rhs.partner) {
+      p += p >= l;
+    }
+    lhs.partner.insert(lhs.partner.begin() + l, r);
+    rhs.partner.insert(rhs.partner.begin() + r, l);
+    refresh_summary(lhs, l);
+    refresh_summary(rhs, r);
+
+    return {this, l};
+  }
+
+  // Удаляет элемент и соответствующий ему парный, возвращает итератор на
+  // следующий элемент. Работает за O(n).
+  left_iterator erase_left(left_iterator it) {
+    return erase_impl<left_tag>(it);
+  }
+
+  bool erase_left(left_t const& left) {
+    return erase_impl<left_tag>(left);
+  }
+
+  right_iterator erase_right(right_iterator it) {
+    return erase_impl<right_tag>(it);
+  }
+
+  bool erase_right(right_t const& right) {
+    return erase_impl<right_tag>(right);
+  }
+
+  // Удаляет [first, last) за один проход по массивам, то есть за O(n).
+  left_iterator erase_left(left_iterator first, left_iterator last) {
+    return erase_impl<left_tag>(first, last);
+  }
+
+  right_iterator erase_right(right_iterator first, right_iterator last) {
+    return erase_impl<right_tag>(first, last);
+  }
+
+  left_iterator find_left(left_t const& left) const {
+    return find_impl<left_tag>(left);
+  }
+
+  right_iterator find_right(right_t const& right) const {
+    return find_impl<right_tag>(right);
+  }
+
+  right_t const& at_left(left_t const& key) const {
+    return at_impl<left_tag>(key);
+  }
+
+  left_t const& at_right(right_t const& key) const {
+    return at_impl<right_tag>(key);
+  }
+
+  template <
+      typename Right1 = right_t,
+      typename = std::enable_if_t<std::is_default_constructible_v<Right1>>>
+  right_t const& at_left_or_default(left_t const& key) {
+    auto it = find_left(key);
+    if (it != end_left()) {
+      return *it.flip();
+    } else {
+      erase_right(right_t());
+      return *insert(key, right_t()).flip();
+    }
+  }
+
+  template <typename Left1 = left_t,
+            typename = std::enable_if_t<std::is_default_constructible_v<Left1>>>
+  left_t const& at_right_or_default(right_t const& key) {
+    auto it = find_right(key);
+    if (it != end_right()) {
+      return *it.flip();
+    } else {
+      erase_left(left_t());
+      return *insert(left_t(), key);
+    }
+  }
+
+  left_iterator lower_bound_left(const left_t& left) const {
+    return {this, lower_bound_index<left_tag>(left)};
+  }
+
+  left_iterator upper_bound_left(const left_t& left) const {
+    return {this, upper_bound_index<left_tag>(left)};
+  }
+
+  right_iterator lower_bound_right(const right_t& right) const {
+    return {this, lower_bound_index<right_tag>(right)};
+  }
+
+  right_iterator upper_bound_right(const right_t& right) const {
+    return {this, upper_bound_index<right_tag>(right)};
+  }
+
+  left_iterator nth_left(size_t k) const {
+    return {this, k < size() ? k : size()};
+  }
+
+  right_iterator nth_right(size_t k) const {
+    return {this, k < size() ? k : size()};
+  }
+
+  size_t rank_left(left_t const& key) const {
+    return lower_bound_index<left_tag>(key);
+  }
+
+  size_t rank_right(right_t const& key) const {
+    return lower_bound_index<right_tag>(key);
+  }
+
+  size_t count_range_left(left_t const& lo, left_t const& hi) const {
+    size_t lo_rank = rank_left(lo);
+    size_t hi_rank = rank_left(hi);
+    return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+  }
+
+  size_t count_range_right(right_t const& lo, right_t const& hi) const {
+    size_t lo_rank = rank_right(lo);
+    size_t hi_rank = rank_right(hi);
+    return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+  }
+
+  left_iterator begin_left() const {
+    return {this, 0};
+  }
+
+  left_iterator end_left() const {
+    return {this, size()};
+  }
+
+  right_iterator begin_right() const {
+    return {this, 0};
+  }
+
+  right_iterator end_right() const {
+    return {this, size()};
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  size_t size() const noexcept {
+    return side_of<left_tag>().keys.size();
+  }
+
+  bool operator==(flat_bimap const& other) const {
+    if (size() != other.size()) {
+      return false;
+    }
+
+    auto& lhs = side_of<left_tag>();
+    auto& other_lhs = other.side_of<left_tag>();
+    auto& rhs = side_of<right_tag>();
+    auto& other_rhs = other.side_of<right_tag>();
+
+    for (size_t i = 0; i < size(); ++i) {
+      if (!(lhs.keys[i] == other_lhs.keys[i])) {
+        return false;
+      }
+
+      if (!(rhs.keys[lhs.partner[i]] == other_rhs.keys[other_lhs.partner[i]])) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool operator!=(flat_bimap const& other) const {
+    return !(*this == other);
+  }
+
+private:
+  template <typename Tag>
+  auto& side_of() noexcept {
+    return static_cast<typename traits<Tag>::side_t&>(sides);
+  }
+
+  template <typename Tag>
+  const auto& side_of() const noexcept {
+    return static_cast<const typename traits<Tag>::side_t&>(sides);
+  }
+
+  template <typename Tag>
+  const auto& compare() const noexcept {
+    return static_cast<const typename traits<Tag>::compare_half_t&>(
+        side_of<Tag>());
+  }
+
+  template <typename Tag, typename K>
+  size_t lower_bound_index(const K& key) const {
+    auto& side = side_of<Tag>();
+    if constexpr (bimap_impl::flat_blocked<typename traits<Tag>::half_t>) {
+      return bimap_impl::block_lower_bound(side.keys.data(), side.keys.size(),
+                                           side.summary.data(), key,
+                                           compare<Tag>());
+    } else {
+      return bimap_impl::flat_lower_bound(side.keys.data(), side.keys.size(),
+                                          key, compare<Tag>());
+    }
+  }
+
+  template <typename Tag, typename K>
+  size_t upper_bound_index(const K& key) const {
+    auto& side = side_of<Tag>();
+    if constexpr (bimap_impl::flat_blocked<typename traits<Tag>::half_t>) {
+      return bimap_impl::block_upper_bound(side.keys.data(), side.keys.size(),
+                                           side.summary.data(), key,
+                                           compare<Tag>());
+    } else {
+      return bimap_impl::flat_upper_bound(side.keys.data(), side.keys.size(),
+                                          key, compare<Tag>());
+    }
+  }
+
+  // Rewrites the last keys of the blocks from the one holding index on.
+  // The summary has room for them after reserve(), and the keys are copied
+  // without exceptions, so it never throws.
+  template <typename Side>
+  static void refresh_summary(Side& side, size_t index) noexcept {
+    using key_t = typename decltype(side.keys)::value_type;
+
+    if constexpr (bimap_impl::flat_blocked<key_t>) {
+      constexpr size_t block = bimap_impl::block_keys<key_t>;
+      size_t size = side.keys.size();
+      size_t blocks = bimap_impl::blocks_count<key_t>(size);
+
+      while (side.summary.size() > blocks) {
+        side.summary.pop_back();
+      }
+
+      for (size_t i = index / block; i < blocks; ++i) {
+        const auto& last = side.keys[std::min((i + 1) * block, size) - 1];
+        if (i < side.summary.size()) {
+          side.summary[i] = last;
+        } else {
+          side.summary.push_back(last);
+        }
+      }
+    }
+  }
+
+  template <typename Tag, typename K>
+  bool contains_at(size_t index, const K& key) const {
+    auto& keys = side_of<Tag>().keys;
+    return index < keys.size() && !compare<Tag>()(key, keys[index]);
+  }
+
+  template <typename Tag, typename K>
+  iterator_impl<Tag> find_impl(const K& key) const {
+    size_t index = lower_bound_index<Tag>(key);
+    return {this, contains_at<Tag>(index, key) ? index : size()};
+  }
+
+  template <typename Tag, typename K>
+  const auto& at_impl(const K& key) const {
+    auto it = find_impl<Tag>(key);
+    if (it.index == size()) {
+      throw std::out_of_range("flat_bimap: out of range");
+    }
+
+    return *it.flip();
+  }
+
+  void reserve(size_t capacity) {
+    reserve(side_of<left_tag>(), capacity);
+    reserve(side_of<right_tag>(), capacity);
+  }
+
+  template <typename Side>
+  static void reserve(Side& side, size_t capacity) {
+    using key_t = typename decltype(side.keys)::value_type;
+
+    side.keys.reserve(capacity);
+    side.partner.reserve(capacity);
+    if constexpr (bimap_impl::flat_blocked<key_t>) {
+      side.summary.reserve(bimap_impl::blocks_count<key_t>(capacity));
+    }
+  }
+
+  template <typename Tag>
+  iterator_impl<Tag> erase_impl(iterator_impl<Tag> it) {
+    using opposite_tag = typename traits<Tag>::opposite::tag;
+
+    auto& own = side_of<Tag>();
+    auto& opposite = side_of<opposite_tag>();
+    size_t index = it.index;
+    size_t partner = own.partner[index];
+
+    own.keys.erase(own.keys.begin() + index);
+    opposite.keys.erase(opposite.keys.begin() + partner);
+    own.partner.erase(own.partner.begin() + index);
+    opposite.partner.erase(opposite.partner.begin() + partner);
+
+    for (auto& p : own.partner) {
+      p -= p > partner;
+    }
+    for (auto& p : opposite.partner) {
+      p -= p > index;
+    }
+    refresh_summary(own, index);
+    refresh_summary(opposite, partner);
+
+    return {this, index};
+  }
+
+  template <typename Tag, typename K>
+  bool erase_impl(const K& key) {
+    auto it = find_impl<Tag>(key);
+    if (it.index == size()) {
+      return false;
+    }
+
+    erase_impl<Tag>(it);
+    return true;
+  }
+
+  // Compacts both sides at once: every surviving element gets its new index
+  // from a prefix count, then partners are remapped.
+  template <typename Tag>
+  iterator_impl<Tag> erase_impl(iterator_impl<Tag> first,
+                                iterator_impl<Tag> last) {
+    using opposite_tag = typename traits<Tag>::opposite::tag;
+
+    if (first == last) {
+      return last;
+    }
+
+    auto& own = side_of<Tag>();
+    auto& opposite = side_of<opposite_tag>();
+    size_t n = size();
+
+    std::vector<size_t> own_index(n);
+    std::vector<size_t> opposite_index(n, 0);
+    for (size_t i = first.index; i < last.index; ++i) {
+      opposite_index[own.partner[i]] = n;
+    }
+
+    for (size_t i = 0, next = 0; i < n; ++i) {
+      own_index[i] = (i >= first.index && i < last.index) ? n : next++;
+    }
+    for (size_t i = 0, next = 0; i < n; ++i) {
+      opposite_index[i] = opposite_index[i] == n ? n : next++;
+    }
+
+    compact(own, own_index, opposite_index, n);
+    compact(opposite, opposite_index, own_index, n);
+    refresh_summary(own, first.index);
+    refresh_summary(opposite, 0);
+
+    return {this, first.index};
+  }
+
+  template <typename Side>
+  static void compact(Side& side, const std::vector<size_t>& index,
+                      const std::vector<size_t>& partner_index, size_t n) {
+    size_t kept = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (index[i] == n) {
+        continue;
+      }
+
+      if (kept != i) {
+        side.keys[kept] = std::move(side.keys[i]);
+      }
+      side.partner[kept] = partner_index[side.partner[i]];
+      ++kept;
+    }
+
+    side.keys.erase(side.keys.begin() + kept, side.keys.end());
+    side.partner.resize(kept);
+  }
+
+  side_pair sides;
+};
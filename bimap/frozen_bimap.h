@@ -0,0 +1,480 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "sorted_search.h"
+
+template <typename Left, typename Right, typename CompareLeft,
+          typename CompareRight, typename Allocator, typename SizePolicy>
+class bimap;
+
+namespace bimap_impl {
+struct left_tag;
+struct right_tag;
+
+// Position of the other half of a pair on the opposite side.
+using frozen_index_t = uint32_t;
+
+template <typename Key, typename Compare, typename Tag>
+struct frozen_side : Compare {
+  explicit frozen_side(Compare compare) : Compare(std::move(compare)) {}
+
+  const Key* keys = nullptr;
+  const frozen_index_t* partner = nullptr;
+  // last key of every cache-line block of keys, see block_lower_bound
+  const Key* summary = nullptr;
+};
+
+// Read-only bimap over externally owned arrays: both sides sorted, blocked by
+// cache lines and linked by partner indices. Owners (frozen_bimap, mapped
+// files) point it at their storage with attach().
+template <typename Left, typename Right, typename CompareLeft,
+          typename CompareRight>
+class frozen_view {
+public:
+  template <typename Tag, typename = void>
+  struct traits;
+
+  template <typename Dummy>
+  struct traits<left_tag, Dummy> {
+    using opposite = traits<right_tag>;
+    using tag = left_tag;
+    using half_t = Left;
+    using compare_half_t = CompareLeft;
+    using side_t = frozen_side<Left, CompareLeft, left_tag>;
+  };
+
+  template <typename Dummy>
+  struct traits<right_tag, Dummy> {
+    using opposite = traits<left_tag>;
+    using tag = right_tag;
+    using half_t = Right;
+    using compare_half_t = CompareRight;
+    using side_t = frozen_side<Right, CompareRight, right_tag>;
+  };
+
+  using left_t = Left;
+  using right_t = Right;
+
+  struct side_pair : traits<left_tag>::side_t, traits<right_tag>::side_t {
+    side_pair(CompareLeft compare_left, CompareRight compare_right)
+        : traits<left_tag>::side_t(std::move(compare_left)),
+          traits<right_tag>::side_t(std::move(compare_right)) {}
+  };
+
+  template <typename Tag>
+  class iterator_impl {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = typename traits<Tag>::half_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    iterator_impl() noexcept = default;
+
+    value_type const& operator*() const {
+      return view->template side_of<Tag>().keys[index];
+    }
+
+    value_type const* operator->() const {
+      return &**this;
+    }
+
+    iterator_impl& operator++() {
+      ++index;
+      return *this;
+    }
+
+    iterator_impl operator++(int) {
+      auto copy = *this;
+      ++index;
+      return copy;
+    }
+
+    iterator_impl& operator--() {
+      --index;
+      return *this;
+    }
+
+    iterator_impl operator--(int) {
+      auto copy = *this;
+      --index;
+      return copy;
+    }
+
+    iterator_impl& operator+=(difference_type n) {
+      index += n;
+      return *this;
+    }
+
+    iterator_impl& operator-=(difference_type n) {
+      index -= n;
+      return *this;
+    }
+
+    iterator_impl operator+(difference_type n) const {
+      return {view, index + n};
+    }
+
+    friend iterator_impl operator+(difference_type n, const iterator_impl& it) {
+      return it + n;
+    }
+
+    iterator_impl operator-(difference_type n) const {
+      return {view, index - n};
+    }
+
+    difference_type operator-(const iterator_impl& other) const {
+      return static_cast<difference_type>(index) -
+             static_cast<difference_type>(other.index);
+    }
+
+    value_type const& operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    // Итератор на противоположный элемент той же пары, end() переходит в
+    // end() противоположной стороны.
+    iterator_impl<typename traits<Tag>::opposite::tag> flip() const {
+      return {view, index < view->count
+                        ? view->template side_of<Tag>().partner[index]
+                        : view->count};
+    }
+
+    bool operator==(const iterator_impl& other) const noexcept {
+      return view == other.view && index == other.index;
+    }
+
+    bool operator!=(const iterator_impl& other) const noexcept {
+      return !(*this == other);
+    }
+
+    bool operator<(const iterator_impl& other) const noexcept {
+      return index < other.index;
+    }
+
+    bool operator>(const iterator_impl& other) const noexcept {
+      return other < *this;
+    }
+
+    bool operator<=(const iterator_impl& other) const noexcept {
+      return !(other < *this);
+    }
+
+    bool operator>=(const iterator_impl& other) const noexcept {
+      return !(*this < other);
+    }
+
+    friend frozen_view;
+
+  private:
+    iterator_impl(const frozen_view* view, size_t index) noexcept
+        : view(view), index(index) {}
+
+    const frozen_view* view = nullptr;
+    size_t index = 0;
+  };
+
+  using left_iterator = iterator_impl<left_tag>;
+  using right_iterator = iterator_impl<right_tag>;
+
+  // Возвращает итератор по элементу. Если не найден - соответствующий end()
+  left_iterator find_left(left_t const& left) const {
+    return find_impl<left_tag>(left);
+  }
+
+  right_iterator find_right(right_t const& right) const {
+    return find_impl<right_tag>(right);
+  }
+
+  // Возвращает противоположный элемент по элементу
+  // Если элемента не существует -- бросает std::out_of_range
+  right_t const& at_left(left_t const& key) const {
+    return at_impl<left_tag>(key);
+  }
+
+  left_t const& at_right(right_t const& key) const {
+    return at_impl<right_tag>(key);
+  }
+
+  left_iterator lower_bound_left(left_t const& left) const {
+    return {this, lower_bound_index<left_tag>(left)};
+  }
+
+  left_iterator upper_bound_left(left_t const& left) const {
+    return {this, upper_bound_index<left_tag>(left)};
+  }
+
+  right_iterator lower_bound_right(right_t const& right) const {
+    return {this, lower_bound_index<right_tag>(right)};
+  }
+
+  right_iterator upper_bound_right(right_t const& right) const {
+    return {this, upper_bound_index<right_tag>(right)};
+  }
+
+  left_iterator nth_left(size_t k) const {
+    return {this, k < count ? k : count};
+  }
+
+  right_iterator nth_right(size_t k) const {
+    return {this, k < count ? k : count};
+  }
+
+  size_t rank_left(left_t const& key) const {
+    return lower_bound_index<left_tag>(key);
+  }
+
+  size_t rank_right(right_t const& key) const {
+    return lower_bound_index<right_tag>(key);
+  }
+
+  size_t count_range_left(left_t const& lo, left_t const& hi) const {
+    size_t lo_rank = rank_left(lo);
+    size_t hi_rank = rank_left(hi);
+    return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+  }
+
+  size_t count_range_right(right_t const& lo, right_t const& hi) const {
+    size_t lo_rank = rank_right(lo);
+    size_t hi_rank = rank_right(hi);
+    return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+  }
+
+  left_iterator begin_left() const {
+    return {this, 0};
+  }
+
+  left_iterator end_left() const {
+    return {this, count};
+  }
+
+  right_iterator begin_right() const {
+    return {this, 0};
+  }
+
+  right_iterator end_right() const {
+    return {this, count};
+  }
+
+  bool empty() const noexcept {
+    return count == 0;
+  }
+
+  size_t size() const noexcept {
+    return count;
+  }
+
+  bool operator==(frozen_view const& other) const {
+    if (count != other.count) {
+      return false;
+    }
+
+    auto& lhs = side_of<left_tag>();
+    auto& other_lhs = other.side_of<left_tag>();
+    auto& rhs = side_of<right_tag>();
+    auto& other_rhs = other.side_of<right_tag>();
+
+    for (size_t i = 0; i < count; ++i) {
+      if (!(lhs.keys[i] == other_lhs.keys[i])) {
+        return false;
+      }
+
+      if (!(rhs.keys[lhs.partner[i]] == other_rhs.keys[other_lhs.partner[i]])) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool operator!=(frozen_view const& other) const {
+    return !(*this == other);
+  }
+
+protected:
+  frozen_view(CompareLeft compare_left, CompareRight compare_right)
+      : sides(std::move(compare_left), std::move(compare_right)) {}
+
+  frozen_view(frozen_view const& other) = default;
+  frozen_view& operator=(frozen_view const& other) = default;
+
+  template <typename Tag>
+  void attach(const typename traits<Tag>::half_t* keys,
+              const frozen_index_t* partner,
+              const typename traits<Tag>::half_t* summary) noexcept {
+    auto& side = static_cast<typename traits<Tag>::side_t&>(sides);
+    side.keys = keys;
+    side.partner = partner;
+    side.summary = summary;
+  }
+
+  void attach_size(size_t size) noexcept {
+    count = size;
+  }
+
+  void swap_view(frozen_view& other) noexcept {
+    std::swap(sides, other.sides);
+    std::swap(count, other.count);
+  }
+
+  template <typename Tag>
+  const auto& side_of() const noexcept {
+    return static_cast<const typename traits<Tag>::side_t&>(sides);
+  }
+
+  template <typename Tag>
+  const auto& compare() const noexcept {
+    return static_cast<const typename traits<Tag>::compare_half_t&>(
+        side_of<Tag>());
+  }
+
+private:
+  template <typename Tag, typename K>
+  size_t lower_bound_index(const K& key) const {
+    auto& side = side_of<Tag>();
+    return block_lower_bound(side.keys, count, side.summary, key,
+                             compare<Tag>());
+  }
+
+  template <typename Tag, typename K>
+  size_t upper_bound_index(const K& key) const {
+    auto& side = side_of<Tag>();
+    return block_upper_bound(side.keys, count, side.summary, key,
+                             compare<Tag>());
+  }
+
+  template <typename Tag, typename K>
+  iterator_impl<Tag> find_impl(const K& key) const {
+    size_t index = lower_bound_index<Tag>(key);
+    bool found =
+        index < count && !compare<Tag>()(key, side_of<Tag>().keys[index]);
+    return {this, found ? index : count};
+  }
+
+  template <typename Tag, typename K>
+  const auto& at_impl(const K& key) const {
+    auto it = find_impl<Tag>(key);
+    if (it.index == count) {
+      throw std::out_of_range("frozen_bimap: out of range");
+    }
+
+    return *it.flip();
+  }
+
+  side_pair sides;
+  size_t count = 0;
+};
+} // namespace bimap_impl
+
+// Неизменяемый снимок bimap, создается bimap::freeze().
+// Каждая сторона хранится отсортированным массивом, выровненным по кэш-линиям,
+// и перестановкой в индексы противоположной стороны, поэтому поиск не ходит
+// по указателям: бинарный поиск по массиву последних ключей блоков и просмотр
+// одного блока размером не больше кэш-линии (для целых ключей с std::less --
+// SSE2-сравнениями, для 64-битных -- SSE4.2, без него блок просматривается
+// скалярно). Блок совпадает с кэш-линией, если sizeof ключа делит ее размер.
+// Итераторы произвольного доступа работают за O(1), flip() -- одно чтение.
+// Перемещение и обмен снимков инвалидируют итераторы.
+template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+class frozen_bimap
+    : public bimap_impl::frozen_view<Left, Right, CompareLeft, CompareRight> {
+  using view_t = bimap_impl::frozen_view<Left, Right, CompareLeft, CompareRight>;
+  using left_tag = bimap_impl::left_tag;
+  using right_tag = bimap_impl::right_tag;
+  using index_t = bimap_impl::frozen_index_t;
+
+  template <typename Key>
+  struct side_storage {
+    std::vector<Key, bimap_impl::cache_aligned_allocator<Key>> keys;
+    std::vector<index_t> partner;
+    std::vector<Key> summary;
+  };
+
+public:
+  // Создает пустой снимок.
+  frozen_bimap(CompareLeft compare_left = CompareLeft(),
+               CompareRight compare_right = CompareRight())
+      : view_t(std::move(compare_left), std::move(compare_right)) {}
+
+  frozen_bimap(frozen_bimap const& other)
+      : view_t(other), lefts(other.lefts), rights(other.rights) {
+    attach_storage();
+  }
+
+  frozen_bimap(frozen_bimap&& other) noexcept
+      : view_t(other), lefts(std::move(other.lefts)),
+        rights(std::move(other.rights)) {
+    attach_storage();
+    other.attach_storage();
+  }
+
+  frozen_bimap& operator=(frozen_bimap other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  void swap(frozen_bimap& other) noexcept {
+    this->swap_view(other);
+    std::swap(lefts, other.lefts);
+    std::swap(rights, other.rights);
+    attach_storage();
+    other.attach_storage();
+  }
+
+private:
+  template <typename, typename, typename, typename, typename, typename>
+  friend class bimap;
+
+  // Copies both sides of source in order; a pair finds its partner index
+  // through the O(log n) iterator difference of the tree.
+  template <typename Bimap>
+  frozen_bimap(const Bimap& source, CompareLeft compare_left,
+               CompareRight compare_right)
+      : view_t(std::move(compare_left), std::move(compare_right)) {
+    if (source.size() > std::numeric_limits<index_t>::max()) {
+      throw std::length_error("frozen_bimap: too many pairs");
+    }
+
+    fill(lefts, source.begin_left(), source.end_left(), source.begin_right(),
+         source.size());
+    fill(rights, source.begin_right(), source.end_right(),
+         source.begin_left(), source.size());
+    attach_storage();
+  }
+
+  template <typename Key, typename It, typename OppositeIt>
+  static void fill(side_storage<Key>& side, It first, It last,
+                   OppositeIt opposite_begin, size_t size) {
+    side.keys.reserve(size);
+    side.partner.reserve(size);
+    for (; first != last; ++first) {
+      side.keys.push_back(*first);
+      side.partner.push_back(static_cast<index_t>(first.flip() - opposite_begin));
+    }
+
+    side.summary.reserve(bimap_impl::blocks_count<Key>(size));
+    bimap_impl::build_summary(side.keys.data(), size,
+                              std::back_inserter(side.summary));
+  }
+
+  void attach_storage() noexcept {
+    this->template attach<left_tag>(lefts.keys.data(), lefts.partner.data(),
+                                    lefts.summary.data());
+    this->template attach<right_tag>(rights.keys.data(), rights.partner.data(),
+                                     rights.summary.data());
+    this->attach_size(lefts.keys.size());
+  }
+
+  side_storage<Left> lefts;
+  side_storage<Right> rights;
+};
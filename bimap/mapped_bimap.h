@@ -0,0 +1,423 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frozen_bimap.h"
+
+namespace bimap_impl {
+// File layout: the header, then for each side its keys, block summary and
+// partner indices. Every array starts on a cache line, so the mapped keys
+// keep the blocking frozen_view searches rely on. Values are stored in host
+// byte order; the header records it along with the key sizes so that a file
+// from an incompatible build is rejected instead of misread.
+struct mapped_header {
+  static constexpr char expected_magic[8] = {'B', 'I', 'M', 'A',
+                                             'P', 'F', 'R', 'Z'};
+  static constexpr uint32_t current_version = 1;
+  static constexpr uint32_t byte_order_mark = 0x01020304;
+
+  struct side {
+    uint64_t keys;
+    uint64_t summary;
+    uint64_t partner;
+    uint32_t key_size;
+    uint32_t key_align;
+  };
+
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t count;
+  uint64_t file_size;
+  side left;
+  side right;
+};
+
+constexpr uint64_t align_to_cache_line(uint64_t offset) noexcept {
+  return (offset + cache_line - 1) & ~uint64_t(cache_line - 1);
+}
+
+template <typename Key>
+mapped_header::side layout_side(uint64_t& offset, size_t count) noexcept {
+  mapped_header::side side{};
+  side.key_size = sizeof(Key);
+  side.key_align = alignof(Key);
+
+  side.keys = offset = align_to_cache_line(offset);
+  offset += count * sizeof(Key);
+  side.summary = offset = align_to_cache_line(offset);
+  offset += blocks_count<Key>(count) * sizeof(Key);
+  side.partner = offset = align_to_cache_line(offset);
+  offset += count * sizeof(frozen_index_t);
+  return side;
+}
+
+inline bool same_layout(const mapped_header::side& lhs,
+                        const mapped_header::side& rhs) noexcept {
+  return lhs.keys == rhs.keys && lhs.summary == rhs.summary &&
+         lhs.partner == rhs.partner && lhs.key_size == rhs.key_size &&
+         lhs.key_align == rhs.key_align;
+}
+
+// Whether count elements of size bytes from offset lie inside the file.
+inline bool fits(uint64_t offset, uint64_t count, uint64_t size,
+                 uint64_t file_size) noexcept {
+  return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+// Checks the arrays of a side against the file before anything is read
+// from them, with no arithmetic that could overflow.
+template <typename Key>
+bool side_fits(const mapped_header::side& side, uint64_t count,
+               uint64_t file_size) noexcept {
+  return fits(side.keys, count, sizeof(Key), file_size) &&
+         fits(side.summary, blocks_count<Key>(count), sizeof(Key), file_size) &&
+         fits(side.partner, count, sizeof(frozen_index_t), file_size);
+}
+
+// Output file written through its descriptor, so that every failure is
+// reported with the errno of the call that failed.
+class file_writer {
+public:
+  file_writer(int fd, const std::string& path) noexcept : fd(fd), path(path) {}
+
+  // Writes data at offset, zero-filling the gap from the current position.
+  void write_at(uint64_t offset, const void* data, size_t size) {
+    static const char zeros[cache_line] = {};
+    while (position < offset) {
+      uint64_t gap =
+          offset - position < cache_line ? offset - position : cache_line;
+      write(zeros, gap);
+    }
+    write(data, size);
+  }
+
+  // Makes the written data durable.
+  void sync() {
+    if (::fsync(fd) != 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+  }
+
+private:
+  void write(const void* data, size_t size) {
+    auto* bytes = static_cast<const char*>(data);
+    while (size != 0) {
+      ssize_t written = ::write(fd, bytes, size);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(), path);
+      }
+      bytes += written;
+      size -= written;
+      position += written;
+    }
+  }
+
+  int fd;
+  const std::string& path;
+  uint64_t position = 0;
+};
+
+// Creates a file with mode 0644 next to target under a unique name, which
+// no other writer can share. Returns the descriptor and stores the name.
+inline int create_temp_file(const std::string& target, std::string& temp_path) {
+  std::vector<char> name(target.begin(), target.end());
+  for (char c : std::string(".XXXXXX")) {
+    name.push_back(c);
+  }
+  name.push_back('\0');
+
+  int fd = ::mkstemp(name.data());
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), target);
+  }
+  temp_path = name.data();
+
+  if (::fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) != 0) {
+    int error = errno;
+    ::close(fd);
+    ::unlink(temp_path.c_str());
+    throw std::system_error(error, std::generic_category(), temp_path);
+  }
+
+  return fd;
+}
+} // namespace bimap_impl
+
+// Неизменяемый bimap, отображенный в память из файла, записанного
+// mapped_bimap::write. Поиск и итерация работают прямо по страницам файла,
+// а процессы, открывшие один файл, разделяют его страницы. Интерфейс тот же,
+// что у frozen_bimap.
+// Left и Right должны быть trivially copyable, компараторы должны задавать
+// тот же порядок, что и при записи. При открытии проверяются заголовок, то,
+// что каждый массив лежит внутри файла, и за один проход по массивам -- что
+// ключи строго возрастают, последние ключи блоков верны, а индексы пар обеих
+// сторон взаимно обратны. Поэтому открытие работает за O(n), а поврежденный
+// файл отвергается, а не читается за пределами отображения.
+template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+class mapped_bimap
+    : public bimap_impl::frozen_view<Left, Right, CompareLeft, CompareRight> {
+  static_assert(std::is_trivially_copyable_v<Left> &&
+                    std::is_trivially_copyable_v<Right>,
+                "mapped_bimap stores keys as raw bytes");
+
+  using view_t = bimap_impl::frozen_view<Left, Right, CompareLeft, CompareRight>;
+  using header_t = bimap_impl::mapped_header;
+  using index_t = bimap_impl::frozen_index_t;
+
+public:
+  // Отображает файл в память только для чтения.
+  // Бросает std::system_error, если файл не удалось открыть или отобразить,
+  // и std::runtime_error, если он не является файлом mapped_bimap для этих
+  // типов или поврежден.
+  explicit mapped_bimap(const std::string& path,
+                        CompareLeft compare_left = CompareLeft(),
+                        CompareRight compare_right = CompareRight())
+      : view_t(std::move(compare_left), std::move(compare_right)) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), path);
+    }
+
+    length = st.st_size;
+    if (length < sizeof(header_t)) {
+      ::close(fd);
+      throw std::runtime_error(path + ": not a mapped_bimap file");
+    }
+
+    void* data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      throw std::system_error(error, std::generic_category(), path);
+    }
+
+    base = static_cast<const char*>(data);
+    try {
+      attach_mapping(path);
+    } catch (...) {
+      ::munmap(const_cast<char*>(base), length);
+      throw;
+    }
+  }
+
+  mapped_bimap(mapped_bimap const& other) = delete;
+  mapped_bimap& operator=(mapped_bimap const& other) = delete;
+
+  mapped_bimap(mapped_bimap&& other) noexcept
+      : view_t(other), base(other.base), length(other.length) {
+    other.base = nullptr;
+    other.length = 0;
+    other.attach_size(0);
+  }
+
+  mapped_bimap& operator=(mapped_bimap&& other) noexcept {
+    mapped_bimap moved(std::move(other));
+    swap(moved);
+    return *this;
+  }
+
+  ~mapped_bimap() {
+    if (base) {
+      ::munmap(const_cast<char*>(base), length);
+    }
+  }
+
+  void swap(mapped_bimap& other) noexcept {
+    this->swap_view(other);
+    std::swap(base, other.base);
+    std::swap(length, other.length);
+  }
+
+  // Записывает пары source (bimap, frozen_bimap или другого bimap с тем же
+  // интерфейсом) в файл, который потом открывается mapped_bimap.
+  // Файл пишется рядом, во временный файл с уникальным именем
+  // path + ".XXXXXX" (mkstemp, права 0644), сбрасывается на диск и заменяет
+  // path через rename, поэтому процессы, отобразившие прежний файл,
+  // продолжают видеть его целиком, а одновременные писатели в один path не
+  // мешают друг другу: остается файл того, кто переименовал последним.
+  // Бросает std::system_error при ошибке записи.
+  template <typename Source>
+  static void write(const Source& source, const std::string& path) {
+    std::string temp_path;
+    int fd = bimap_impl::create_temp_file(path, temp_path);
+    try {
+      bimap_impl::file_writer out(fd, temp_path);
+      write_file(source, out);
+      out.sync();
+
+      int result = ::close(fd);
+      fd = -1;
+      if (result != 0) {
+        throw std::system_error(errno, std::generic_category(), temp_path);
+      }
+
+      if (::rename(temp_path.c_str(), path.c_str()) != 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+      }
+    } catch (...) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      ::unlink(temp_path.c_str());
+      throw;
+    }
+  }
+
+private:
+  template <typename Source>
+  static void write_file(const Source& source, bimap_impl::file_writer& out) {
+    if (source.size() > std::numeric_limits<index_t>::max()) {
+      throw std::length_error("mapped_bimap: too many pairs");
+    }
+
+    size_t count = source.size();
+
+    header_t header{};
+    std::memcpy(header.magic, header_t::expected_magic, sizeof(header.magic));
+    header.version = header_t::current_version;
+    header.byte_order = header_t::byte_order_mark;
+    header.count = count;
+
+    uint64_t offset = sizeof(header_t);
+    header.left = bimap_impl::layout_side<Left>(offset, count);
+    header.right = bimap_impl::layout_side<Right>(offset, count);
+    header.file_size = offset;
+
+    out.write_at(0, &header, sizeof(header));
+    write_side(out, header.left, source.begin_left(), source.end_left(),
+               source.begin_right());
+    write_side(out, header.right, source.begin_right(), source.end_right(),
+               source.begin_left());
+    out.write_at(header.file_size, nullptr, 0);
+  }
+
+  template <typename It, typename OppositeIt>
+  static void write_side(bimap_impl::file_writer& out,
+                         const header_t::side& layout,
+                         It first, It last, OppositeIt opposite_begin) {
+    using key_t = typename std::iterator_traits<It>::value_type;
+
+    std::vector<key_t> keys(first, last);
+    std::vector<key_t> summary;
+    bimap_impl::build_summary(keys.data(), keys.size(),
+                              std::back_inserter(summary));
+    std::vector<index_t> partner;
+    partner.reserve(keys.size());
+    for (; first != last; ++first) {
+      partner.push_back(static_cast<index_t>(first.flip() - opposite_begin));
+    }
+
+    out.write_at(layout.keys, keys.data(), keys.size() * sizeof(key_t));
+    out.write_at(layout.summary, summary.data(),
+                 summary.size() * sizeof(key_t));
+    out.write_at(layout.partner, partner.data(),
+                 partner.size() * sizeof(index_t));
+  }
+
+  const header_t& header() const noexcept {
+    return *reinterpret_cast<const header_t*>(base);
+  }
+
+  void attach_mapping(const std::string& path) {
+    auto& h = header();
+    if (std::memcmp(h.magic, header_t::expected_magic, sizeof(h.magic)) != 0 ||
+        h.version != header_t::current_version ||
+        h.byte_order != header_t::byte_order_mark || h.file_size != length ||
+        h.count > std::numeric_limits<index_t>::max()) {
+      throw std::runtime_error(path + ": not a mapped_bimap file");
+    }
+
+    if (!bimap_impl::side_fits<Left>(h.left, h.count, length) ||
+        !bimap_impl::side_fits<Right>(h.right, h.count, length)) {
+      throw std::runtime_error(path + ": arrays out of the file");
+    }
+
+    uint64_t offset = sizeof(header_t);
+    auto left = bimap_impl::layout_side<Left>(offset, h.count);
+    auto right = bimap_impl::layout_side<Right>(offset, h.count);
+    if (!bimap_impl::same_layout(h.left, left) ||
+        !bimap_impl::same_layout(h.right, right) || offset != length) {
+      throw std::runtime_error(path + ": wrong key types or truncated file");
+    }
+
+    this->template attach<bimap_impl::left_tag>(
+        reinterpret_cast<const Left*>(base + h.left.keys),
+        reinterpret_cast<const index_t*>(base + h.left.partner),
+        reinterpret_cast<const Left*>(base + h.left.summary));
+    this->template attach<bimap_impl::right_tag>(
+        reinterpret_cast<const Right*>(base + h.right.keys),
+        reinterpret_cast<const index_t*>(base + h.right.partner),
+        reinterpret_cast<const Right*>(base + h.right.summary));
+
+    if (!valid_side<bimap_impl::left_tag>(h.count) ||
+        !valid_side<bimap_impl::right_tag>(h.count)) {
+      throw std::runtime_error(path + ": corrupt arrays");
+    }
+    this->attach_size(h.count);
+  }
+
+  // Checks in one pass everything lookups rely on: keys strictly increasing
+  // under the comparator, the summary holding the last key of every block,
+  // and partner indices of the two sides inverse to each other, so that
+  // flip() never leaves the mapping.
+  template <typename Tag>
+  bool valid_side(size_t count) const {
+    using traits_t = typename view_t::template traits<Tag>;
+    using key_t = typename traits_t::half_t;
+    constexpr size_t block = bimap_impl::block_keys<key_t>;
+
+    auto& side = this->template side_of<Tag>();
+    auto& opposite = this->template side_of<typename traits_t::opposite::tag>();
+    auto& less = this->template compare<Tag>();
+
+    for (size_t i = 0; i < count; ++i) {
+      if (i != 0 && !less(side.keys[i - 1], side.keys[i])) {
+        return false;
+      }
+      if (side.partner[i] >= count || opposite.partner[side.partner[i]] != i) {
+        return false;
+      }
+    }
+
+    for (size_t b = 0; b < bimap_impl::blocks_count<key_t>(count); ++b) {
+      const key_t& last = side.keys[std::min((b + 1) * block, count) - 1];
+      if (less(last, side.summary[b]) || less(side.summary[b], last)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  const char* base = nullptr;
+  size_t length = 0;
+};
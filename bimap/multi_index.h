@@ -0,0 +1,485 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "binode.h"
+#include "slab_allocator.h"
+
+// Описание упорядоченного индекса multi_index: записи упорядочены по ключу
+// типа Key компаратором Compare, ключи в индексе уникальны. Tag - любой
+// тип, по которому индекс выбирается.
+template <typename Tag, typename Key, typename Compare = std::less<Key>>
+struct ordered_unique {
+  using tag = Tag;
+  using key_type = Key;
+  using compare = Compare;
+};
+
+// Список индексов multi_index.
+template <typename... Indices>
+struct indexed_by {};
+
+namespace bimap_impl {
+template <typename T>
+struct type_identity {
+  using type = T;
+};
+
+// The index of Indices whose tag is Tag.
+template <typename Tag, typename... Indices>
+struct find_index {};
+
+template <typename Tag, typename First, typename... Rest>
+struct find_index<Tag, First, Rest...> {
+  using type = typename std::conditional_t<
+      std::is_same_v<Tag, typename First::tag>, type_identity<First>,
+      find_index<Tag, Rest...>>::type;
+};
+
+// Node of a multi_index: binode generalized to any number of indexes. It
+// holds the key of every index in the node of its treap and the record
+// itself, and all the treaps share one rank.
+template <typename Record, typename... Indices>
+struct multi_node
+    : node<typename Indices::key_type, typename Indices::tag>... {
+  template <typename R, typename... Keys>
+  multi_node(R&& record, uint32_t rank, Keys&&... keys)
+      : node<typename Indices::key_type, typename Indices::tag>(
+            std::piecewise_construct,
+            std::forward_as_tuple(std::forward<Keys>(keys)))...,
+        record(std::forward<R>(record)), rank(rank) {}
+
+  template <typename Tag>
+  const auto& as_node() const noexcept {
+    using index = typename find_index<Tag, Indices...>::type;
+    return static_cast<const node<typename index::key_type, Tag>&>(*this);
+  }
+
+  template <typename Tag>
+  auto& as_node() noexcept {
+    using index = typename find_index<Tag, Indices...>::type;
+    return static_cast<node<typename index::key_type, Tag>&>(*this);
+  }
+
+  template <typename Tag>
+  const auto& key() const noexcept {
+    return as_node<Tag>().key;
+  }
+
+  template <typename Tag>
+  auto& key() noexcept {
+    return as_node<Tag>().key;
+  }
+
+  Record record;
+  const uint32_t rank;
+};
+} // namespace bimap_impl
+
+// Контейнер записей с несколькими упорядоченными индексами, обобщение bimap
+// на N сторон. Индексы задаются как indexed_by<ordered_unique<Tag, Key,
+// Compare>...>, и каждый хранит свой ключ записи. Запись со всеми ключами
+// лежит в одном узле, который входит в декартово дерево каждого индекса,
+// поэтому вставка и удаление делают одну аллокацию через Allocator, а
+// индексы всегда согласованы.
+// iterator<Tag> обходит записи в порядке ключей индекса Tag: *it - запись,
+// it.key<OtherTag>() - ее ключ в любом индексе, it.project<OtherTag>() -
+// итератор на ту же запись в другом индексе.
+template <typename Record, typename IndexList,
+          typename Allocator = std::allocator<Record>>
+class multi_index;
+
+template <typename Record, typename... Indices, typename Allocator>
+class multi_index<Record, indexed_by<Indices...>, Allocator> {
+  static_assert(sizeof...(Indices) > 0, "multi_index needs an index");
+
+  using node_t = bimap_impl::multi_node<Record, Indices...>;
+  using first_tag =
+      typename std::tuple_element_t<0, std::tuple<Indices...>>::tag;
+
+  using node_allocator_t = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<node_t>;
+  using node_allocator_traits_t = std::allocator_traits<node_allocator_t>;
+
+  template <typename Tag>
+  using index_t = typename bimap_impl::find_index<Tag, Indices...>::type;
+
+  template <typename Tag>
+  using tree_t = bimap_impl::treap<node_t, typename index_t<Tag>::key_type,
+                                   typename index_t<Tag>::compare, Tag>;
+
+  // Tags are distinct, so every treap is a distinct base. The allocator is
+  // kept next to them so that an empty one takes no space.
+  struct tree_set
+      : bimap_impl::treap<node_t, typename Indices::key_type,
+                          typename Indices::compare, typename Indices::tag>...,
+        node_allocator_t {};
+
+public:
+  using record_t = Record;
+  using allocator_type = Allocator;
+
+  template <typename Tag>
+  using key_t = typename index_t<Tag>::key_type;
+
+  template <typename Tag>
+  class iterator {
+    using tree_iterator_t = typename tree_t<Tag>::const_iterator;
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Record;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Record*;
+    using reference = const Record&;
+
+    iterator() noexcept = default;
+
+    // Разыменование end() неопределено.
+    const Record& operator*() const noexcept {
+      return cur->record;
+    }
+
+    const Record* operator->() const noexcept {
+      return &cur->record;
+    }
+
+    // Ключ записи в индексе KeyTag.
+    template <typename KeyTag>
+    const key_t<KeyTag>& key() const noexcept {
+      return cur->template key<KeyTag>();
+    }
+
+    iterator& operator++() noexcept {
+      ++cur;
+      return *this;
+    }
+
+    iterator operator++(int) noexcept {
+      return cur++;
+    }
+
+    iterator& operator--() noexcept {
+      --cur;
+      return *this;
+    }
+
+    iterator operator--(int) noexcept {
+      return cur--;
+    }
+
+    // Итератор на ту же запись в индексе To, end() переходит в end().
+    template <typename To>
+    iterator<To> project() const noexcept {
+      if (cur.cur->get_parent() == nullptr) {
+        auto& tree = tree_t<Tag>::dummy_as_treap(*cur.cur);
+        return static_cast<const tree_t<To>&>(
+                   static_cast<const tree_set&>(tree))
+            .end();
+      }
+
+      return iterator<To>(*cur);
+    }
+
+    bool operator==(const iterator& other) const noexcept {
+      return cur == other.cur;
+    }
+
+    bool operator!=(const iterator& other) const noexcept {
+      return cur != other.cur;
+    }
+
+  private:
+    friend multi_index;
+
+    template <typename>
+    friend class iterator;
+
+    iterator(tree_iterator_t cur) noexcept : cur(cur) {}
+
+    iterator(const node_t& node) noexcept : cur(&node.template as_node<Tag>()) {}
+
+    tree_iterator_t cur;
+  };
+
+  // Создает пустой multi_index.
+  multi_index() = default;
+
+  explicit multi_index(const Allocator& alloc)
+      : trees{tree_t<typename Indices::tag>()..., node_allocator_t(alloc)} {}
+
+  explicit multi_index(typename Indices::compare... compares,
+                       const Allocator& alloc = Allocator())
+      : trees{tree_t<typename Indices::tag>(std::move(compares))...,
+              node_allocator_t(alloc)} {}
+
+  // Копия получает деревья той же формы за O(n) в среднем, как копия bimap;
+  // other только читается.
+  multi_index(multi_index const& other)
+      : multi_index(
+            other.tree<typename Indices::tag>().key_comp()...,
+            Allocator(
+                node_allocator_traits_t::select_on_container_copy_construction(
+                    other.node_allocator()))) {
+    clone(other);
+  }
+
+  multi_index(multi_index&& other) noexcept = default;
+
+  multi_index& operator=(multi_index const& other) {
+    if (this != &other) {
+      multi_index copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+
+  // Узлы принадлежат аллокатору, поэтому они обмениваются вместе с ним.
+  multi_index& operator=(multi_index&& other) noexcept {
+    if (this != &other) {
+      multi_index moved(std::move(other));
+      swap(moved);
+    }
+    return *this;
+  }
+
+  ~multi_index() noexcept {
+    clear();
+  }
+
+  void swap(multi_index& other) noexcept {
+    using std::swap;
+    (tree_t<typename Indices::tag>::swap(tree<typename Indices::tag>(),
+                                         other.tree<typename Indices::tag>()),
+     ...);
+    swap(node_allocator(), other.node_allocator());
+  }
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type(node_allocator());
+  }
+
+  // Вставляет запись с ключами keys (по одному на индекс, в порядке
+  // Indices) и возвращает итератор на нее в первом индексе. Если хотя бы
+  // один ключ уже занят, вставка не производится и возвращается end()
+  // первого индекса. Каждое дерево проходится один раз.
+  iterator<first_tag> insert(Record record, typename Indices::key_type... keys) {
+    auto positions =
+        std::make_tuple(tree<typename Indices::tag>().locate(keys)...);
+    bool taken = std::apply(
+        [](auto const&... position) { return (position.child || ...); },
+        positions);
+    if (taken) {
+      return end<first_tag>();
+    }
+
+    auto* node = create_node(std::move(record), rand_rank(), std::move(keys)...);
+    std::apply(
+        [&](auto const&... position) {
+          (tree<typename Indices::tag>().insert(position, *node), ...);
+        },
+        positions);
+
+    return *node;
+  }
+
+  // Удаляет запись, возвращает итератор на следующую в том же индексе.
+  template <typename Tag>
+  iterator<Tag> erase(iterator<Tag> it) noexcept {
+    auto next = it;
+    ++next;
+
+    auto& node = const_cast<node_t&>(*it.cur);
+    (tree<typename Indices::tag>().erase(node), ...);
+    destroy_node(node);
+
+    return next;
+  }
+
+  // Удаляет запись по ключу индекса Tag, возвращает была ли она удалена.
+  template <typename Tag>
+  bool erase(key_t<Tag> const& key) {
+    auto it = find<Tag>(key);
+    if (it == end<Tag>()) {
+      return false;
+    }
+
+    erase<Tag>(it);
+    return true;
+  }
+
+  // Заменяет ключ записи в индексе Tag, перевешивая узел только в его
+  // дереве; it может быть итератором любого индекса и остается валидным.
+  // Если ключ занят другой записью, ничего не делает и возвращает false.
+  // Если присваивание ключа бросает исключение, запись удаляется.
+  template <typename Tag, typename ItTag>
+  bool replace(iterator<ItTag> it, key_t<Tag> key) {
+    auto& node = const_cast<node_t&>(*it.cur);
+    auto position = tree<Tag>().locate(key);
+    if (position.child && position.child != &node.template as_node<Tag>()) {
+      return false;
+    }
+
+    try {
+      tree<Tag>().replace_key(node, position,
+                              [&](auto& old_key) { old_key = std::move(key); });
+    } catch (...) {
+      (erase_from<typename Indices::tag, Tag>(node), ...);
+      destroy_node(node);
+      throw;
+    }
+
+    return true;
+  }
+
+  // Изменяет запись функцией f(Record&). Ключи при этом не меняются, и
+  // индексы не затрагиваются.
+  template <typename Tag, typename F>
+  void modify(iterator<Tag> it, F&& f) {
+    std::forward<F>(f)(const_cast<node_t&>(*it.cur).record);
+  }
+
+  // Удаляет все записи за O(n) одним обходом дерева первого индекса. Если
+  // узлы лежат в slab_allocator, которым больше никто не пользуется, и
+  // записи с ключами тривиально разрушаемы, арена освобождается целиком.
+  void clear() noexcept {
+    if constexpr (bimap_impl::is_slab_allocator<node_allocator_t>::value &&
+                  std::is_trivially_destructible_v<node_t>) {
+      if (node_allocator().reset_if_unique()) {
+        (tree<typename Indices::tag>().forget(), ...);
+        return;
+      }
+    }
+
+    (forget_unless_first<typename Indices::tag>(), ...);
+    tree<first_tag>().clear([this](node_t& node) { destroy_node(node); });
+  }
+
+  // Возвращает итератор на запись с ключом key в индексе Tag или end().
+  template <typename Tag>
+  iterator<Tag> find(key_t<Tag> const& key) const noexcept {
+    return tree<Tag>().find(key);
+  }
+
+  template <typename Tag>
+  iterator<Tag> lower_bound(key_t<Tag> const& key) const noexcept {
+    return tree<Tag>().lower_bound(key);
+  }
+
+  template <typename Tag>
+  iterator<Tag> upper_bound(key_t<Tag> const& key) const noexcept {
+    return tree<Tag>().upper_bound(key);
+  }
+
+  template <typename Tag>
+  iterator<Tag> begin() const noexcept {
+    return tree<Tag>().begin();
+  }
+
+  template <typename Tag>
+  iterator<Tag> end() const noexcept {
+    return tree<Tag>().end();
+  }
+
+  bool empty() const noexcept {
+    return tree<first_tag>().empty();
+  }
+
+  size_t size() const noexcept {
+    return tree<first_tag>().size();
+  }
+
+private:
+  // The first tree is copied with new nodes, recorded in a copy table
+  // through which the other trees link the same nodes, as in bimap.
+  // Must be called on an empty multi_index.
+  void clone(const multi_index& other) {
+    bimap_impl::copy_table<node_t> copies(other.size());
+    tree<first_tag>().clone(
+        other.tree<first_tag>(),
+        [&](const node_t& node) -> node_t& {
+          auto* copy = create_node(node.record, node.rank,
+                                   node.template key<typename Indices::tag>()...);
+          copies.add(node, *copy);
+          return *copy;
+        },
+        [this](node_t& node) { destroy_node(node); });
+    (clone_unless_first<typename Indices::tag>(other, copies), ...);
+  }
+
+  template <typename Tag>
+  void clone_unless_first(const multi_index& other,
+                          const bimap_impl::copy_table<node_t>& copies) noexcept {
+    if constexpr (!std::is_same_v<Tag, first_tag>) {
+      tree<Tag>().clone(
+          other.tree<Tag>(),
+          [&](const node_t& node) -> node_t& { return copies.find(node); },
+          [](node_t&) {});
+    }
+  }
+
+  template <typename... Args>
+  node_t* create_node(Args&&... args) {
+    auto& alloc = node_allocator();
+    node_t* node = node_allocator_traits_t::allocate(alloc, 1);
+
+    try {
+      node_allocator_traits_t::construct(alloc, node,
+                                         std::forward<Args>(args)...);
+    } catch (...) {
+      node_allocator_traits_t::deallocate(alloc, node, 1);
+      throw;
+    }
+
+    return node;
+  }
+
+  void destroy_node(node_t& node) noexcept {
+    auto& alloc = node_allocator();
+    node_allocator_traits_t::destroy(alloc, &node);
+    node_allocator_traits_t::deallocate(alloc, &node, 1);
+  }
+
+  node_allocator_t& node_allocator() noexcept {
+    return static_cast<node_allocator_t&>(trees);
+  }
+
+  const node_allocator_t& node_allocator() const noexcept {
+    return static_cast<const node_allocator_t&>(trees);
+  }
+
+  template <typename Tag>
+  tree_t<Tag>& tree() noexcept {
+    return static_cast<tree_t<Tag>&>(trees);
+  }
+
+  template <typename Tag>
+  const tree_t<Tag>& tree() const noexcept {
+    return static_cast<const tree_t<Tag>&>(trees);
+  }
+
+  template <typename Tag>
+  void forget_unless_first() noexcept {
+    if constexpr (!std::is_same_v<Tag, first_tag>) {
+      tree<Tag>().forget();
+    }
+  }
+
+  // The node is already out of the Skip tree.
+  template <typename Tag, typename Skip>
+  void erase_from(node_t& node) noexcept {
+    if constexpr (!std::is_same_v<Tag, Skip>) {
+      tree<Tag>().erase(node);
+    }
+  }
+
+  tree_set trees;
+  bimap_impl::priority_source rand_rank{static_cast<const void*>(this)};
+};
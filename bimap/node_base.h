@@ -1,14 +1,59 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
 namespace bimap_impl {
-struct node_base {
-  node_base() = default;
+// Size policies of tree nodes, a template parameter of the containers.
+// Subtree sizes back order statistics: nth, rank and iterator arithmetic in
+// O(log n). subtree_sizes<uint32_t> limits a tree to 2^32 - 2 nodes but lets
+// a small key share the word with the size; no_subtree_sizes drops the field
+// together with the operations that need it, and saves the walks up to the
+// root that keep sizes right after every change.
+template <typename SizeType>
+struct subtree_sizes {
+  static_assert(std::is_unsigned_v<SizeType>);
+  using size_type = SizeType;
+};
+
+struct no_subtree_sizes {};
+
+template <typename SizePolicy>
+constexpr bool has_subtree_sizes =
+    !std::is_same_v<SizePolicy, no_subtree_sizes>;
+
+// Fields of a node, kept in a base so that the size can be left out while
+// staying after the pointers, where a small key may take its tail padding.
+template <typename Node, typename SizePolicy>
+struct node_fields {
+  Node* parent = nullptr;
+  Node* left = nullptr;
+  Node* right = nullptr;
+  typename SizePolicy::size_type size = 1;
+};
+
+template <typename Node>
+struct node_fields<Node, no_subtree_sizes> {
+  Node* parent = nullptr;
+  Node* left = nullptr;
+  Node* right = nullptr;
+};
 
-  node_base(const node_base& other) = delete;
-  node_base(node_base&& other) = delete;
+template <typename SizePolicy>
+struct basic_node_base
+    : private node_fields<basic_node_base<SizePolicy>, SizePolicy> {
+  using node_base = basic_node_base;
 
-  node_base& operator=(const node_base& other) = delete;
-  node_base& operator=(node_base& other) = delete;
+  static constexpr bool sized = has_subtree_sizes<SizePolicy>;
+
+  basic_node_base() = default;
+
+  basic_node_base(const basic_node_base& other) = delete;
+  basic_node_base(basic_node_base&& other) = delete;
+
+  basic_node_base& operator=(const basic_node_base& other) = delete;
+  basic_node_base& operator=(basic_node_base& other) = delete;
 
   void set_left(node_base* node) noexcept {
     left = node;
@@ -30,6 +75,66 @@ struct node_base {
     update_size();
   }
 
+  // Same as set_left and set_right, but sizes are left for the caller to fix,
+  // e.g. with update_path_sizes() from the lowest modified node.
+  void link_left(node_base* node) noexcept {
+    left = node;
+
+    if (node) {
+      node->parent = this;
+    }
+  }
+
+  void link_right(node_base* node) noexcept {
+    right = node;
+
+    if (node) {
+      node->parent = this;
+    }
+  }
+
+  // Puts node in place of this one in the parent's child pointer.
+  void replace_with(node_base* node) noexcept {
+    auto*& self_ptr = parent->left == this ? parent->left : parent->right;
+
+    self_ptr = node;
+    if (node) {
+      node->parent = parent;
+    }
+  }
+
+  // Lifts this node above its parent keeping the in-order sequence.
+  // Sizes of both nodes are fixed, sizes of the ancestors do not change.
+  void rotate_up() noexcept {
+    auto* old_parent = parent;
+    old_parent->replace_with(this);
+
+    if (old_parent->left == this) {
+      old_parent->link_left(right);
+      link_right(old_parent);
+    } else {
+      old_parent->link_right(left);
+      link_left(old_parent);
+    }
+
+    old_parent->update_size();
+    update_size();
+  }
+
+  void detach_parent() noexcept {
+    parent = nullptr;
+  }
+
+  // Makes the node a standalone one-element tree.
+  void reset() noexcept {
+    parent = nullptr;
+    left = nullptr;
+    right = nullptr;
+    if constexpr (sized) {
+      this->size = 1;
+    }
+  }
+
   static void unset(node_base* node) noexcept {
     if (!node) {
       return;
@@ -53,7 +158,7 @@ struct node_base {
     }
 
     auto* cur = this;
-    while (parent != nullptr && cur->parent->left != cur) {
+    while (cur->parent != nullptr && cur->parent->left != cur) {
       cur = cur->parent;
     }
 
@@ -70,7 +175,7 @@ struct node_base {
     }
 
     auto* cur = this;
-    while (parent != nullptr && cur->parent->right != cur) {
+    while (cur->parent != nullptr && cur->parent->right != cur) {
       cur = cur->parent;
     }
 
@@ -103,10 +208,64 @@ struct node_base {
     return cur;
   }
 
+  // Position of this node in order in the whole tree. The topmost node (the
+  // treap's dummy) gets the position right after the last real node.
+  size_t index() const noexcept {
+    static_assert(sized, "order statistics need subtree sizes");
+    size_t result = left ? left->size : 0;
+
+    for (auto* cur = this; cur->parent != nullptr; cur = cur->parent) {
+      if (cur->parent->right == cur) {
+        result += (cur->parent->left ? cur->parent->left->size : 0) + 1;
+      }
+    }
+
+    return result;
+  }
+
+  const node_base* top() const noexcept {
+    auto* cur = this;
+    while (cur->parent != nullptr) {
+      cur = cur->parent;
+    }
+
+    return cur;
+  }
+
+  // k-th (from zero) node in order in the subtree of this node.
+  // k must be less than get_size().
+  const node_base* nth(size_t k) const noexcept {
+    static_assert(sized, "order statistics need subtree sizes");
+    auto* cur = this;
+    while (true) {
+      size_t left_size = cur->left ? cur->left->size : 0;
+      if (k < left_size) {
+        cur = cur->left;
+      } else if (k == left_size) {
+        return cur;
+      } else {
+        k -= left_size + 1;
+        cur = cur->right;
+      }
+    }
+  }
+
   void update_size() noexcept {
-    size_t left_size = left ? left->size : 0;
-    size_t right_size = right ? right->size : 0;
-    size = left_size + right_size + 1;
+    if constexpr (sized) {
+      using size_type = typename SizePolicy::size_type;
+      size_type left_size = left ? left->size : 0;
+      size_type right_size = right ? right->size : 0;
+      this->size = left_size + right_size + 1;
+    }
+  }
+
+  // Recomputes sizes from this node up to the root.
+  void update_path_sizes() noexcept {
+    if constexpr (sized) {
+      for (auto* cur = this; cur != nullptr; cur = cur->parent) {
+        cur->update_size();
+      }
+    }
   }
 
   node_base* get_parent() noexcept {
@@ -134,13 +293,15 @@ struct node_base {
   }
 
   size_t get_size() const noexcept {
-    return size;
+    static_assert(sized, "order statistics need subtree sizes");
+    return this->size;
   }
 
 private:
-  node_base* parent = nullptr;
-  node_base* left = nullptr;
-  node_base* right = nullptr;
-  size_t size = 1;
+  using fields_t = node_fields<basic_node_base, SizePolicy>;
+
+  using fields_t::left;
+  using fields_t::parent;
+  using fields_t::right;
 };
 } // namespace bimap_impl
@@ -0,0 +1,522 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "binode.h"
+#include "persistent_treap.h"
+
+template <typename Left, typename Right, typename CompareLeft,
+          typename CompareRight>
+class concurrent_bimap;
+
+// bimap с копированием за O(1). Пары хранятся в двух персистентных
+// декартовых деревьях (left -> right и right -> left) с общими узлами:
+// копия разделяет все узлы с оригиналом, а insert и erase копируют только
+// путь до изменяемого ключа, O(log n) узлов. Поэтому снимок можно делать на
+// каждую пачку запросов.
+// Итераторы хранят позицию и путь от корня до узла (узлы неизменяемы, так
+// что путь остается верным, пока bimap не изменен): разыменование O(1), ++ и
+// -- за амортизированное O(1), сдвиг на n и flip() O(log n). Изменение bimap
+// инвалидирует его итераторы и ссылки, копии при этом не затрагиваются.
+template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+class persistent_bimap {
+public:
+  using left_tag = bimap_impl::left_tag;
+  using right_tag = bimap_impl::right_tag;
+
+  using left_t = Left;
+  using right_t = Right;
+
+  template <typename Tag, typename = void>
+  struct traits;
+
+  template <typename Dummy>
+  struct traits<left_tag, Dummy> {
+    using opposite = traits<right_tag>;
+    using tag = left_tag;
+    using half_t = Left;
+    using tree_t = bimap_impl::persistent_treap<Left, Right, CompareLeft>;
+  };
+
+  template <typename Dummy>
+  struct traits<right_tag, Dummy> {
+    using opposite = traits<left_tag>;
+    using tag = right_tag;
+    using half_t = Right;
+    using tree_t = bimap_impl::persistent_treap<Right, Left, CompareRight>;
+  };
+
+  template <typename Tag>
+  class iterator_impl {
+    using node_t = typename traits<Tag>::tree_t::node_t;
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = typename traits<Tag>::half_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    iterator_impl() noexcept = default;
+
+    value_type const& operator*() const {
+      return node->key;
+    }
+
+    value_type const* operator->() const {
+      return &node->key;
+    }
+
+    iterator_impl& operator++() {
+      ++index;
+      if (!tracked) {
+        return seek(index);
+      }
+
+      if (node->right) {
+        return descend(node->right, &node_t::left);
+      }
+      return ascend(&node_t::right);
+    }
+
+    iterator_impl operator++(int) {
+      auto copy = *this;
+      ++*this;
+      return copy;
+    }
+
+    iterator_impl& operator--() {
+      --index;
+      if (!tracked || !node) {
+        return seek(index);
+      }
+
+      if (node->left) {
+        return descend(node->left, &node_t::right);
+      }
+      return ascend(&node_t::left);
+    }
+
+    iterator_impl operator--(int) {
+      auto copy = *this;
+      --*this;
+      return copy;
+    }
+
+    iterator_impl& operator+=(difference_type n) {
+      return seek(index + n);
+    }
+
+    iterator_impl& operator-=(difference_type n) {
+      return *this += -n;
+    }
+
+    iterator_impl operator+(difference_type n) const {
+      auto copy = *this;
+      return copy += n;
+    }
+
+    friend iterator_impl operator+(difference_type n, const iterator_impl& it) {
+      return it + n;
+    }
+
+    iterator_impl operator-(difference_type n) const {
+      auto copy = *this;
+      return copy -= n;
+    }
+
+    difference_type operator-(const iterator_impl& other) const {
+      return static_cast<difference_type>(index) -
+             static_cast<difference_type>(other.index);
+    }
+
+    value_type const& operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    // Итератор на противоположный элемент той же пары, end() переходит в
+    // end() противоположной стороны.
+    iterator_impl<typename traits<Tag>::opposite::tag> flip() const {
+      using opposite_tag = typename traits<Tag>::opposite::tag;
+      if (!node) {
+        return map->template end_impl<opposite_tag>();
+      }
+
+      return map->template position<opposite_tag>(node->mapped);
+    }
+
+    bool operator==(const iterator_impl& other) const noexcept {
+      return map == other.map && index == other.index;
+    }
+
+    bool operator!=(const iterator_impl& other) const noexcept {
+      return !(*this == other);
+    }
+
+    bool operator<(const iterator_impl& other) const noexcept {
+      return index < other.index;
+    }
+
+    bool operator>(const iterator_impl& other) const noexcept {
+      return other < *this;
+    }
+
+    bool operator<=(const iterator_impl& other) const noexcept {
+      return !(other < *this);
+    }
+
+    bool operator>=(const iterator_impl& other) const noexcept {
+      return !(*this < other);
+    }
+
+    friend persistent_bimap;
+
+  private:
+    // Deeper paths are not kept, the iterator then steps through seek().
+    static constexpr size_t max_depth = 64;
+
+    explicit iterator_impl(const persistent_bimap* map) noexcept : map(map) {}
+
+    // Positions the iterator at the k-th node, or at end() if there is none,
+    // recording the path from the root.
+    iterator_impl& seek(size_t k) noexcept {
+      index = k;
+      depth = 0;
+      tracked = true;
+      node = map->template tree<Tag>().root_node();
+      while (node) {
+        size_t left = node_t::size_of(node->left);
+        if (k == left) {
+          break;
+        }
+
+        push(node);
+        if (k < left) {
+          node = node->left;
+        } else {
+          k -= left + 1;
+          node = node->right;
+        }
+      }
+
+      if (!node) {
+        index = map->size();
+      }
+      return *this;
+    }
+
+    // Moves to the outermost node of the subtree at from, following child.
+    iterator_impl& descend(const node_t* from,
+                           node_t* const node_t::*child) noexcept {
+      push(node);
+      node = from;
+      while (node->*child) {
+        push(node);
+        node = node->*child;
+      }
+      return tracked ? *this : seek(index);
+    }
+
+    // Moves to the nearest ancestor the node is not in the child subtree of,
+    // or to end() if there is none.
+    iterator_impl& ascend(node_t* const node_t::*child) noexcept {
+      while (depth > 0 && path[depth - 1]->*child == node) {
+        node = path[--depth];
+      }
+      node = depth > 0 ? path[--depth] : nullptr;
+      return *this;
+    }
+
+    void push(const node_t* ancestor) noexcept {
+      if (depth < max_depth) {
+        path[depth++] = ancestor;
+      } else {
+        tracked = false;
+      }
+    }
+
+    const persistent_bimap* map = nullptr;
+    size_t index = 0;
+    const node_t* node = nullptr;
+    size_t depth = 0;
+    bool tracked = false;
+    const node_t* path[max_depth] = {};
+  };
+
+  using left_iterator = iterator_impl<left_tag>;
+  using right_iterator = iterator_impl<right_tag>;
+
+  // Создает bimap не содержащий ни одной пары.
+  persistent_bimap(CompareLeft compare_left = CompareLeft(),
+                   CompareRight compare_right = CompareRight())
+      : trees{typename traits<left_tag>::tree_t(std::move(compare_left)),
+              typename traits<right_tag>::tree_t(std::move(compare_right))} {}
+
+  // Копирование за O(1): копия разделяет узлы с оригиналом.
+  persistent_bimap(persistent_bimap const& other) = default;
+  persistent_bimap(persistent_bimap&& other) noexcept = default;
+
+  persistent_bimap& operator=(persistent_bimap const& other) = default;
+  persistent_bimap& operator=(persistent_bimap&& other) noexcept = default;
+
+  void swap(persistent_bimap& other) noexcept {
+    tree<left_tag>().swap(other.tree<left_tag>());
+    tree<right_tag>().swap(other.tree<right_tag>());
+    std::swap(rand_rank, other.rand_rank);
+  }
+
+  // Вставка пары (left, right), возвращает итератор на left.
+  // Если такой left или такой right уже присутствуют, вставка не
+  // производится и возвращается end_left().
+  left_iterator insert(left_t left, right_t right) {
+    if (tree<left_tag>().find(left) || tree<right_tag>().find(right)) {
+      return end_left();
+    }
+
+    uint32_t rank = rand_rank();
+    auto lefts = tree<left_tag>();
+    lefts.insert(left, right, rank);
+    tree<right_tag>().insert(right, left, rank);
+    tree<left_tag>().swap(lefts);
+
+    return position<left_tag>(left);
+  }
+
+  // Удаляет элемент и соответствующий ему парный, возвращает итератор на
+  // следующий элемент.
+  left_iterator erase_left(left_iterator it) {
+    return erase_impl<left_tag>(it);
+  }
+
+  bool erase_left(left_t const& left) {
+    return erase_impl<left_tag>(left);
+  }
+
+  right_iterator erase_right(right_iterator it) {
+    return erase_impl<right_tag>(it);
+  }
+
+  bool erase_right(right_t const& right) {
+    return erase_impl<right_tag>(right);
+  }
+
+  // Возвращает итератор по элементу. Если не найден - соответствующий end()
+  left_iterator find_left(left_t const& left) const {
+    return find_impl<left_tag>(left);
+  }
+
+  right_iterator find_right(right_t const& right) const {
+    return find_impl<right_tag>(right);
+  }
+
+  // Возвращает противоположный элемент по элементу
+  // Если элемента не существует -- бросает std::out_of_range
+  right_t const& at_left(left_t const& key) const {
+    return at_impl<left_tag>(key);
+  }
+
+  left_t const& at_right(right_t const& key) const {
+    return at_impl<right_tag>(key);
+  }
+
+  template <
+      typename Right1 = right_t,
+      typename = std::enable_if_t<std::is_default_constructible_v<Right1>>>
+  right_t const& at_left_or_default(left_t const& key) {
+    if (auto* node = tree<left_tag>().find(key)) {
+      return node->mapped;
+    }
+
+    erase_right(right_t());
+    insert(key, right_t());
+    return at_left(key);
+  }
+
+  template <typename Left1 = left_t,
+            typename = std::enable_if_t<std::is_default_constructible_v<Left1>>>
+  left_t const& at_right_or_default(right_t const& key) {
+    if (auto* node = tree<right_tag>().find(key)) {
+      return node->mapped;
+    }
+
+    erase_left(left_t());
+    insert(left_t(), key);
+    return at_right(key);
+  }
+
+  left_iterator lower_bound_left(const left_t& left) const {
+    return at_index<left_tag>(tree<left_tag>().lower_bound(left));
+  }
+
+  left_iterator upper_bound_left(const left_t& left) const {
+    return at_index<left_tag>(tree<left_tag>().upper_bound(left));
+  }
+
+  right_iterator lower_bound_right(const right_t& right) const {
+    return at_index<right_tag>(tree<right_tag>().lower_bound(right));
+  }
+
+  right_iterator upper_bound_right(const right_t& right) const {
+    return at_index<right_tag>(tree<right_tag>().upper_bound(right));
+  }
+
+  left_iterator nth_left(size_t k) const {
+    return at_index<left_tag>(k);
+  }
+
+  right_iterator nth_right(size_t k) const {
+    return at_index<right_tag>(k);
+  }
+
+  left_iterator begin_left() const {
+    return at_index<left_tag>(0);
+  }
+
+  left_iterator end_left() const {
+    return end_impl<left_tag>();
+  }
+
+  right_iterator begin_right() const {
+    return at_index<right_tag>(0);
+  }
+
+  right_iterator end_right() const {
+    return end_impl<right_tag>();
+  }
+
+  bool empty() const noexcept {
+    return tree<left_tag>().empty();
+  }
+
+  size_t size() const noexcept {
+    return tree<left_tag>().size();
+  }
+
+  // операторы сравнения
+  bool operator==(persistent_bimap const& other) const {
+    if (size() != other.size()) {
+      return false;
+    }
+
+    bool equal = true;
+    auto it = other.begin_left();
+    tree<left_tag>().for_each([&](const left_t& left, const right_t& right) {
+      equal = equal && left == *it && right == it.node->mapped;
+      ++it;
+    });
+    return equal;
+  }
+
+  bool operator!=(persistent_bimap const& other) const {
+    return !(*this == other);
+  }
+
+private:
+  template <typename, typename, typename, typename>
+  friend class concurrent_bimap;
+
+  persistent_bimap(typename traits<left_tag>::tree_t lefts,
+                   typename traits<right_tag>::tree_t rights)
+      : trees{std::move(lefts), std::move(rights)} {}
+
+  // Members rather than bases: both trees have the same type when Left and
+  // Right coincide.
+  struct tree_pair {
+    typename traits<left_tag>::tree_t lefts;
+    typename traits<right_tag>::tree_t rights;
+  };
+
+  template <typename Tag>
+  auto& tree() noexcept {
+    if constexpr (std::is_same_v<Tag, left_tag>) {
+      return trees.lefts;
+    } else {
+      return trees.rights;
+    }
+  }
+
+  template <typename Tag>
+  const auto& tree() const noexcept {
+    if constexpr (std::is_same_v<Tag, left_tag>) {
+      return trees.lefts;
+    } else {
+      return trees.rights;
+    }
+  }
+
+  template <typename Tag>
+  iterator_impl<Tag> at_index(size_t index) const {
+    iterator_impl<Tag> it(this);
+    it.seek(index);
+    return it;
+  }
+
+  template <typename Tag>
+  iterator_impl<Tag> end_impl() const {
+    iterator_impl<Tag> it(this);
+    it.index = size();
+    return it;
+  }
+
+  // Iterator to a key known to be present.
+  template <typename Tag, typename K>
+  iterator_impl<Tag> position(const K& key) const {
+    return at_index<Tag>(tree<Tag>().lower_bound(key));
+  }
+
+  template <typename Tag, typename K>
+  iterator_impl<Tag> find_impl(const K& key) const {
+    auto* node = tree<Tag>().find(key);
+    return node ? position<Tag>(key) : end_impl<Tag>();
+  }
+
+  template <typename Tag, typename K>
+  const auto& at_impl(const K& key) const {
+    auto* node = tree<Tag>().find(key);
+    if (!node) {
+      throw std::out_of_range("persistent_bimap: out of range");
+    }
+
+    return node->mapped;
+  }
+
+  // Both trees are changed on copies first, so a throwing copy of a key
+  // leaves the bimap as it was.
+  template <typename Tag, typename K>
+  void erase_pair(const K& key) {
+    using opposite_tag = typename traits<Tag>::opposite::tag;
+
+    auto own = tree<Tag>();
+    auto opposite = tree<opposite_tag>();
+    opposite.erase(own.find(key)->mapped);
+    own.erase(key);
+    tree<Tag>().swap(own);
+    tree<opposite_tag>().swap(opposite);
+  }
+
+  template <typename Tag>
+  iterator_impl<Tag> erase_impl(iterator_impl<Tag> it) {
+    size_t index = it.index;
+    erase_pair<Tag>(*it);
+    return at_index<Tag>(index);
+  }
+
+  template <typename Tag, typename K>
+  bool erase_impl(const K& key) {
+    if (!tree<Tag>().find(key)) {
+      return false;
+    }
+
+    erase_pair<Tag>(key);
+    return true;
+  }
+
+  tree_pair trees;
+  bimap_impl::priority_source rand_rank{static_cast<const void*>(this)};
+};
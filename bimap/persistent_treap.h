@@ -0,0 +1,282 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace bimap_impl {
+// Node of a persistent treap. Nodes never change after construction, so a
+// tree can be read by any number of threads while a new version is being
+// built from it; versions share unchanged subtrees and count references to
+// them.
+template <typename Key, typename Mapped>
+struct persistent_node {
+  persistent_node(Key key, Mapped mapped, uint32_t rank, persistent_node* left,
+                  persistent_node* right) noexcept
+      : key(std::move(key)), mapped(std::move(mapped)), rank(rank),
+        size(1 + size_of(left) + size_of(right)), left(left), right(right) {}
+
+  static size_t size_of(const persistent_node* node) noexcept {
+    return node ? node->size : 0;
+  }
+
+  const Key key;
+  const Mapped mapped;
+  const uint32_t rank;
+  const size_t size;
+  persistent_node* const left;
+  persistent_node* const right;
+  mutable std::atomic<size_t> refs{1};
+};
+
+// Owning reference to a persistent node.
+template <typename Key, typename Mapped>
+class node_ref {
+  using node_t = persistent_node<Key, Mapped>;
+
+public:
+  node_ref() noexcept = default;
+
+  explicit node_ref(node_t* node) noexcept : node(node) {}
+
+  static node_ref share(const node_t* node) noexcept {
+    if (node) {
+      node->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node_ref(const_cast<node_t*>(node));
+  }
+
+  node_ref(node_ref const& other) noexcept : node_ref(share(other.node)) {}
+
+  node_ref(node_ref&& other) noexcept : node(other.node) {
+    other.node = nullptr;
+  }
+
+  node_ref& operator=(node_ref other) noexcept {
+    std::swap(node, other.node);
+    return *this;
+  }
+
+  ~node_ref() {
+    destroy(node);
+  }
+
+  const node_t* get() const noexcept {
+    return node;
+  }
+
+  node_t* release() noexcept {
+    return std::exchange(node, nullptr);
+  }
+
+private:
+  // Frees the nodes no other version refers to. Chains of uniquely owned
+  // nodes are followed iteratively down the right spine.
+  static void destroy(node_t* node) noexcept {
+    while (node && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      node_t* right = node->right;
+      destroy(node->left);
+      delete node;
+      node = right;
+    }
+  }
+
+  node_t* node = nullptr;
+};
+
+// Treap with path copying: insert and erase leave the previous root intact
+// and return a new one sharing all untouched subtrees, so copying a treap is
+// O(1) and old versions stay readable. Every node keeps its subtree size for
+// order statistics.
+template <typename Key, typename Mapped, typename Compare>
+class persistent_treap : Compare {
+public:
+  using node_t = persistent_node<Key, Mapped>;
+  using ref_t = node_ref<Key, Mapped>;
+
+  explicit persistent_treap(Compare compare = Compare())
+      : Compare(std::move(compare)) {}
+
+  void swap(persistent_treap& other) noexcept {
+    std::swap(static_cast<Compare&>(*this), static_cast<Compare&>(other));
+    std::swap(root, other.root);
+  }
+
+  const Compare& key_comp() const noexcept {
+    return *this;
+  }
+
+  size_t size() const noexcept {
+    return node_t::size_of(root.get());
+  }
+
+  bool empty() const noexcept {
+    return root.get() == nullptr;
+  }
+
+  template <typename K>
+  const node_t* find(const K& key) const {
+    const node_t* cur = root.get();
+    while (cur) {
+      if (cmp(key, cur->key)) {
+        cur = cur->left;
+      } else if (cmp(cur->key, key)) {
+        cur = cur->right;
+      } else {
+        return cur;
+      }
+    }
+
+    return nullptr;
+  }
+
+  // Number of keys less than key.
+  template <typename K>
+  size_t lower_bound(const K& key) const {
+    size_t rank = 0;
+    for (const node_t* cur = root.get(); cur;) {
+      if (cmp(cur->key, key)) {
+        rank += node_t::size_of(cur->left) + 1;
+        cur = cur->right;
+      } else {
+        cur = cur->left;
+      }
+    }
+
+    return rank;
+  }
+
+  // Number of keys not greater than key.
+  template <typename K>
+  size_t upper_bound(const K& key) const {
+    size_t rank = 0;
+    for (const node_t* cur = root.get(); cur;) {
+      if (cmp(key, cur->key)) {
+        cur = cur->left;
+      } else {
+        rank += node_t::size_of(cur->left) + 1;
+        cur = cur->right;
+      }
+    }
+
+    return rank;
+  }
+
+  // Nodes are immutable, so the tree may be walked from the root directly.
+  const node_t* root_node() const noexcept {
+    return root.get();
+  }
+
+  // Precondition: key is absent.
+  void insert(Key key, Mapped mapped, uint32_t rank) {
+    root = insert(root.get(), key, mapped, rank);
+  }
+
+  // Precondition: key is present.
+  template <typename K>
+  void erase(const K& key) {
+    root = erase(root.get(), key);
+  }
+
+  // Calls f(key, mapped) for every node in key order.
+  template <typename F>
+  void for_each(F&& f) const {
+    for_each(root.get(), f);
+  }
+
+private:
+  template <typename Lhs, typename Rhs>
+  bool cmp(const Lhs& lhs, const Rhs& rhs) const {
+    return static_cast<const Compare&>(*this)(lhs, rhs);
+  }
+
+  static ref_t make(const node_t* source, ref_t left, ref_t right) {
+    return make(source->key, source->mapped, source->rank, std::move(left),
+                std::move(right));
+  }
+
+  // Children are handed over only once the node is allocated and the key
+  // and mapped value are copied, so a throwing copy frees them.
+  static ref_t make(const Key& key, const Mapped& mapped, uint32_t rank,
+                    ref_t left, ref_t right) {
+    Key key_copy(key);
+    Mapped mapped_copy(mapped);
+    return ref_t(new node_t(std::move(key_copy), std::move(mapped_copy), rank,
+                            left.release(), right.release()));
+  }
+
+  // Copies of the paths to key: left gets the keys less than key.
+  template <typename K>
+  std::pair<ref_t, ref_t> split(const node_t* t, const K& key) const {
+    if (!t) {
+      return {};
+    }
+
+    if (cmp(t->key, key)) {
+      auto [left, right] = split(t->right, key);
+      return {make(t, ref_t::share(t->left), std::move(left)),
+              std::move(right)};
+    } else {
+      auto [left, right] = split(t->left, key);
+      return {std::move(left),
+              make(t, std::move(right), ref_t::share(t->right))};
+    }
+  }
+
+  static ref_t merge(const node_t* lhs, const node_t* rhs) {
+    if (!lhs) {
+      return ref_t::share(rhs);
+    }
+    if (!rhs) {
+      return ref_t::share(lhs);
+    }
+
+    if (lhs->rank > rhs->rank) {
+      return make(lhs, ref_t::share(lhs->left), merge(lhs->right, rhs));
+    } else {
+      return make(rhs, merge(lhs, rhs->left), ref_t::share(rhs->right));
+    }
+  }
+
+  ref_t insert(const node_t* t, const Key& key, const Mapped& mapped,
+               uint32_t rank) const {
+    if (!t) {
+      return make(key, mapped, rank, {}, {});
+    }
+
+    if (rank > t->rank) {
+      auto [left, right] = split(t, key);
+      return make(key, mapped, rank, std::move(left), std::move(right));
+    }
+
+    if (cmp(key, t->key)) {
+      return make(t, insert(t->left, key, mapped, rank), ref_t::share(t->right));
+    } else {
+      return make(t, ref_t::share(t->left), insert(t->right, key, mapped, rank));
+    }
+  }
+
+  template <typename K>
+  ref_t erase(const node_t* t, const K& key) const {
+    if (cmp(key, t->key)) {
+      return make(t, erase(t->left, key), ref_t::share(t->right));
+    } else if (cmp(t->key, key)) {
+      return make(t, ref_t::share(t->left), erase(t->right, key));
+    } else {
+      return merge(t->left, t->right);
+    }
+  }
+
+  template <typename F>
+  static void for_each(const node_t* t, F& f) {
+    while (t) {
+      for_each(t->left, f);
+      f(t->key, t->mapped);
+      t = t->right;
+    }
+  }
+
+  ref_t root;
+};
+} // namespace bimap_impl
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace bimap_impl {
+// Arena shared by all copies of a slab_allocator. Memory is carved out of
+// geometrically growing chunks, freed blocks are recycled through free lists
+// keyed by block size, and chunks are returned to the system only when the
+// last allocator referring to the arena goes away. The first few distinct
+// block sizes get a free list each; blocks of any other size come from the
+// upstream operator new and go back to it as soon as they are freed.
+class slab_arena {
+public:
+  slab_arena() noexcept = default;
+
+  slab_arena(const slab_arena& other) = delete;
+  slab_arena& operator=(const slab_arena& other) = delete;
+
+  ~slab_arena() {
+    release_chunks();
+    release_upstream();
+  }
+
+  void* allocate(size_t size, size_t align) {
+    size = block_size(size);
+
+    auto* list = claim_free_list(size, align);
+    if (!list) {
+      return allocate_upstream(size, align);
+    }
+    if (list->head) {
+      auto* block = list->head;
+      list->head = block->next;
+      return block;
+    }
+
+    void* ptr = cur;
+    size_t space = end - cur;
+    if (!std::align(align, size, ptr, space)) {
+      grow(size + align);
+      ptr = cur;
+      space = end - cur;
+      std::align(align, size, ptr, space);
+    }
+
+    cur = static_cast<char*>(ptr) + size;
+    return ptr;
+  }
+
+  // Free lists are claimed on allocation and kept until reset(), so a block
+  // has a free list here exactly if it was carved out of a chunk.
+  void deallocate(void* ptr, size_t size, size_t align) noexcept {
+    size = block_size(size);
+
+    auto* list = find_free_list(size, align);
+    if (!list) {
+      deallocate_upstream(ptr, align);
+      return;
+    }
+
+    list->head = ::new (ptr) free_block{list->head};
+  }
+
+  // Frees every chunk and upstream block at once, invalidating all blocks
+  // handed out.
+  void reset() noexcept {
+    release_chunks();
+    release_upstream();
+    cur = nullptr;
+    end = nullptr;
+    next_chunk_size = min_chunk_size;
+    for (auto& list : free_lists) {
+      list = free_list();
+    }
+  }
+
+  bool unique() const noexcept {
+    return refs == 1;
+  }
+
+  void retain() noexcept {
+    ++refs;
+  }
+
+  // Returns true if the caller was the last owner of the arena.
+  bool release() noexcept {
+    return --refs == 0;
+  }
+
+private:
+  struct alignas(std::max_align_t) chunk {
+    chunk* next;
+  };
+
+  struct free_block {
+    free_block* next;
+  };
+
+  struct free_list {
+    size_t size = 0;
+    size_t align = 0;
+    free_block* head = nullptr;
+  };
+
+  // Header in front of every upstream block, linking them so that reset()
+  // and the destructor can free the blocks the container did not.
+  struct upstream_block {
+    upstream_block* prev;
+    upstream_block* next;
+    size_t align;
+  };
+
+  static constexpr size_t free_lists_count = 4;
+  static constexpr size_t min_chunk_size = size_t(1) << 12;
+  static constexpr size_t max_chunk_size = size_t(1) << 20;
+
+  static size_t block_size(size_t size) noexcept {
+    size = size < sizeof(free_block) ? sizeof(free_block) : size;
+    return (size + alignof(free_block) - 1) & ~(alignof(free_block) - 1);
+  }
+
+  free_list* find_free_list(size_t size, size_t align) noexcept {
+    for (auto& list : free_lists) {
+      if (list.size == size && list.align == align) {
+        return &list;
+      }
+    }
+
+    return nullptr;
+  }
+
+  free_list* claim_free_list(size_t size, size_t align) noexcept {
+    if (auto* list = find_free_list(size, align)) {
+      return list;
+    }
+
+    auto* list = find_free_list(0, 0);
+    if (list) {
+      list->size = size;
+      list->align = align;
+    }
+    return list;
+  }
+
+  static size_t upstream_align(size_t align) noexcept {
+    return align < alignof(upstream_block) ? alignof(upstream_block) : align;
+  }
+
+  static size_t upstream_offset(size_t align) noexcept {
+    align = upstream_align(align);
+    return (sizeof(upstream_block) + align - 1) & ~(align - 1);
+  }
+
+  void* allocate_upstream(size_t size, size_t align) {
+    size_t offset = upstream_offset(align);
+    if (size > std::numeric_limits<size_t>::max() - offset) {
+      throw std::bad_alloc();
+    }
+
+    void* raw = ::operator new(offset + size,
+                               std::align_val_t(upstream_align(align)));
+    auto* block = ::new (raw) upstream_block{nullptr, upstream, align};
+    if (upstream) {
+      upstream->prev = block;
+    }
+    upstream = block;
+    return static_cast<char*>(raw) + offset;
+  }
+
+  void deallocate_upstream(void* ptr, size_t align) noexcept {
+    auto* block = reinterpret_cast<upstream_block*>(static_cast<char*>(ptr) -
+                                                    upstream_offset(align));
+    if (block->prev) {
+      block->prev->next = block->next;
+    } else {
+      upstream = block->next;
+    }
+    if (block->next) {
+      block->next->prev = block->prev;
+    }
+    free_upstream(block);
+  }
+
+  static void free_upstream(upstream_block* block) noexcept {
+    ::operator delete(block, std::align_val_t(upstream_align(block->align)));
+  }
+
+  void release_upstream() noexcept {
+    while (upstream) {
+      auto* next = upstream->next;
+      free_upstream(upstream);
+      upstream = next;
+    }
+  }
+
+  void release_chunks() noexcept {
+    while (chunks) {
+      auto* next = chunks->next;
+      ::operator delete(chunks);
+      chunks = next;
+    }
+  }
+
+  void grow(size_t min_size) {
+    size_t size = next_chunk_size;
+    if (size < min_size + sizeof(chunk)) {
+      size = min_size + sizeof(chunk);
+    }
+
+    auto* raw = static_cast<chunk*>(::operator new(size));
+    raw->next = chunks;
+    chunks = raw;
+
+    cur = reinterpret_cast<char*>(raw) + sizeof(chunk);
+    end = reinterpret_cast<char*>(raw) + size;
+
+    if (next_chunk_size < max_chunk_size) {
+      next_chunk_size *= 2;
+    }
+  }
+
+  chunk* chunks = nullptr;
+  char* cur = nullptr;
+  char* end = nullptr;
+  size_t next_chunk_size = min_chunk_size;
+  upstream_block* upstream = nullptr;
+  free_list free_lists[free_lists_count];
+  size_t refs = 1;
+};
+
+// Stateful allocator backed by a slab_arena. Copies (including rebound ones)
+// share the arena and compare equal; copying a container selects a fresh
+// arena, so every container frees its nodes en bloc when it dies.
+// The arena is not synchronized: allocators sharing it must not be used
+// from several threads at once.
+template <typename T>
+class slab_allocator {
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+  using is_always_equal = std::false_type;
+
+  slab_allocator() : arena(new slab_arena()) {}
+
+  slab_allocator(const slab_allocator& other) noexcept : arena(other.arena) {
+    arena->retain();
+  }
+
+  template <typename U>
+  slab_allocator(const slab_allocator<U>& other) noexcept
+      : arena(other.arena) {
+    arena->retain();
+  }
+
+  slab_allocator& operator=(const slab_allocator& other) noexcept {
+    slab_allocator copy(other);
+    std::swap(arena, copy.arena);
+    return *this;
+  }
+
+  ~slab_allocator() {
+    if (arena->release()) {
+      delete arena;
+    }
+  }
+
+  T* allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+
+    return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) noexcept {
+    arena->deallocate(ptr, n * sizeof(T), alignof(T));
+  }
+
+  // Frees all memory of the arena at once if no other allocator shares it,
+  // so that a container being cleared may skip deallocating its nodes one
+  // by one. Returns whether the arena was reset.
+  bool reset_if_unique() noexcept {
+    if (!arena->unique()) {
+      return false;
+    }
+
+    arena->reset();
+    return true;
+  }
+
+  slab_allocator select_on_container_copy_construction() const {
+    return slab_allocator();
+  }
+
+  template <typename U>
+  bool operator==(const slab_allocator<U>& other) const noexcept {
+    return arena == other.arena;
+  }
+
+  template <typename U>
+  bool operator!=(const slab_allocator<U>& other) const noexcept {
+    return arena != other.arena;
+  }
+
+private:
+  template <typename U>
+  friend class slab_allocator;
+
+  slab_arena* arena;
+};
+
+template <typename Allocator>
+struct is_slab_allocator : std::false_type {};
+
+template <typename T>
+struct is_slab_allocator<slab_allocator<T>> : std::true_type {};
+} // namespace bimap_impl
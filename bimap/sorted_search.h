@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+namespace bimap_impl {
+// Branchless lower bound over a contiguous sorted array: the loop has a fixed
+// trip count and no unpredictable branches, and the two candidate halves of
+// the next step are prefetched, so large arrays are searched at memory
+// bandwidth rather than at branch-miss latency.
+template <typename Key, typename K, typename Compare>
+size_t flat_lower_bound(const Key* keys, size_t size, const K& key,
+                        const Compare& compare) noexcept {
+  if (size == 0) {
+    return 0;
+  }
+
+  const Key* base = keys;
+  while (size > 1) {
+    size_t half = size / 2;
+    __builtin_prefetch(base + half / 2);
+    __builtin_prefetch(base + half + half / 2);
+    base = compare(base[half - 1], key) ? base + half : base;
+    size -= half;
+  }
+
+  return (base - keys) + (compare(*base, key) ? 1 : 0);
+}
+
+template <typename Key, typename K, typename Compare>
+size_t flat_upper_bound(const Key* keys, size_t size, const K& key,
+                        const Compare& compare) noexcept {
+  if (size == 0) {
+    return 0;
+  }
+
+  const Key* base = keys;
+  while (size > 1) {
+    size_t half = size / 2;
+    __builtin_prefetch(base + half / 2);
+    __builtin_prefetch(base + half + half / 2);
+    base = compare(key, base[half - 1]) ? base : base + half;
+    size -= half;
+  }
+
+  return (base - keys) + (compare(key, *base) ? 0 : 1);
+}
+
+constexpr size_t cache_line = 64;
+
+// Keys are grouped into blocks of as many keys as fit in a cache line. A
+// block search first finds the block in the summary array, which holds the
+// last key of every block and is block_keys times smaller than the keys,
+// then scans that block. When sizeof(Key) divides the line, blocks of an
+// aligned array are exactly its lines; other sizes leave the blocks
+// unpadded, so that keys stay contiguous, and a block may straddle two
+// lines.
+template <typename Key>
+constexpr size_t block_keys = sizeof(Key) >= cache_line ? 1 : cache_line / sizeof(Key);
+
+template <typename Key>
+constexpr size_t blocks_count(size_t size) noexcept {
+  return (size + block_keys<Key> - 1) / block_keys<Key>;
+}
+
+// Allocator for the key arrays of a block search, which start on a cache
+// line, and so does every block when sizeof(Key) divides the line.
+template <typename T>
+struct cache_aligned_allocator {
+  using value_type = T;
+
+  cache_aligned_allocator() noexcept = default;
+
+  template <typename U>
+  cache_aligned_allocator(const cache_aligned_allocator<U>&) noexcept {}
+
+  T* allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+
+    return static_cast<T*>(
+        ::operator new(n * sizeof(T), std::align_val_t(cache_line)));
+  }
+
+  void deallocate(T* ptr, size_t) noexcept {
+    ::operator delete(ptr, std::align_val_t(cache_line));
+  }
+
+  template <typename U>
+  bool operator==(const cache_aligned_allocator<U>&) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const cache_aligned_allocator<U>&) const noexcept {
+    return false;
+  }
+};
+
+// A full block of integers ordered by std::less is compared against the key
+// a vector at a time instead of a scalar scan: 8, 16 and 32-bit keys need
+// SSE2, 64-bit keys need the signed 64-bit compare of SSE4.2 and are scanned
+// as scalars without it. Unsigned keys get their top bit flipped, which maps
+// them onto the signed order the compare instructions implement.
+template <typename Key>
+constexpr bool simd_key =
+#ifdef __SSE2__
+    std::is_integral_v<Key> && !std::is_same_v<Key, bool> &&
+#ifdef __SSE4_2__
+    sizeof(Key) <= 8;
+#else
+    sizeof(Key) <= 4;
+#endif
+#else
+    false;
+#endif
+
+template <typename Key, typename K, typename Compare>
+constexpr bool simd_block_search =
+    simd_key<Key> && std::is_same_v<K, Key> &&
+    (std::is_same_v<Compare, std::less<Key>> ||
+     std::is_same_v<Compare, std::less<>>);
+
+#ifdef __SSE2__
+template <typename Key>
+__m128i simd_broadcast(Key key) noexcept {
+  if constexpr (sizeof(Key) == 1) {
+    return _mm_set1_epi8(static_cast<char>(key));
+  } else if constexpr (sizeof(Key) == 2) {
+    return _mm_set1_epi16(static_cast<short>(key));
+  } else if constexpr (sizeof(Key) == 4) {
+    return _mm_set1_epi32(static_cast<int32_t>(key));
+  } else {
+    return _mm_set1_epi64x(static_cast<int64_t>(key));
+  }
+}
+
+// Lanes of lhs greater than the ones of rhs, as signed integers.
+template <typename Key>
+__m128i simd_greater(__m128i lhs, __m128i rhs) noexcept {
+  if constexpr (sizeof(Key) == 1) {
+    return _mm_cmpgt_epi8(lhs, rhs);
+  } else if constexpr (sizeof(Key) == 2) {
+    return _mm_cmpgt_epi16(lhs, rhs);
+  } else if constexpr (sizeof(Key) == 4) {
+    return _mm_cmpgt_epi32(lhs, rhs);
+  } else {
+#ifdef __SSE4_2__
+    return _mm_cmpgt_epi64(lhs, rhs);
+#else
+    static_assert(sizeof(Key) != 8, "64-bit compare needs SSE4.2");
+    return lhs;
+#endif
+  }
+}
+
+// Number of keys in a full block that are less than key (or, with or_equal,
+// not greater than key).
+template <typename Key>
+size_t simd_count_less(const Key* block, Key key, bool or_equal) noexcept {
+  using signed_key = std::make_signed_t<Key>;
+  const __m128i bias = simd_broadcast<Key>(
+      std::is_signed_v<Key> ? 0 : std::numeric_limits<signed_key>::min());
+  const __m128i needle = _mm_xor_si128(simd_broadcast(key), bias);
+
+  // Every lane sets sizeof(Key) bits of the byte mask.
+  size_t bits = 0;
+  for (size_t i = 0; i < block_keys<Key>; i += 16 / sizeof(Key)) {
+    __m128i keys = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i)), bias);
+    __m128i mask = or_equal ? simd_greater<Key>(keys, needle)
+                            : simd_greater<Key>(needle, keys);
+    bits += __builtin_popcount(_mm_movemask_epi8(mask));
+  }
+
+  size_t count = bits / sizeof(Key);
+  return or_equal ? block_keys<Key> - count : count;
+}
+#endif
+
+// Position of the first key in [first, last) of a single block for which
+// stop(key) holds; the block is sorted, so the scan stays in one cache line.
+template <typename Key, typename Stop>
+size_t scan_block(const Key* keys, size_t first, size_t last, Stop&& stop) {
+  while (first != last && !stop(keys[first])) {
+    ++first;
+  }
+
+  return first;
+}
+
+template <typename Key, typename K, typename Compare>
+size_t block_lower_bound(const Key* keys, size_t size, const Key* summary,
+                         const K& key, const Compare& compare) {
+  size_t block = flat_lower_bound(summary, blocks_count<Key>(size), key, compare);
+  size_t first = block * block_keys<Key>;
+  if (first >= size) {
+    return size;
+  }
+
+  size_t last = first + block_keys<Key>;
+#ifdef __SSE2__
+  if constexpr (simd_block_search<Key, K, Compare>) {
+    if (last <= size) {
+      return first + simd_count_less(keys + first, key, false);
+    }
+  }
+#endif
+
+  return scan_block(keys, first, last < size ? last : size,
+                    [&](const Key& k) { return !compare(k, key); });
+}
+
+template <typename Key, typename K, typename Compare>
+size_t block_upper_bound(const Key* keys, size_t size, const Key* summary,
+                         const K& key, const Compare& compare) {
+  size_t block = flat_upper_bound(summary, blocks_count<Key>(size), key, compare);
+  size_t first = block * block_keys<Key>;
+  if (first >= size) {
+    return size;
+  }
+
+  size_t last = first + block_keys<Key>;
+#ifdef __SSE2__
+  if constexpr (simd_block_search<Key, K, Compare>) {
+    if (last <= size) {
+      return first + simd_count_less(keys + first, key, true);
+    }
+  }
+#endif
+
+  return scan_block(keys, first, last < size ? last : size,
+                    [&](const Key& k) { return compare(key, k); });
+}
+
+// Fills summary with the last key of every block of keys.
+template <typename Key, typename OutputIt>
+void build_summary(const Key* keys, size_t size, OutputIt out) {
+  for (size_t last = block_keys<Key>; last - block_keys<Key> < size;
+       last += block_keys<Key>) {
+    *out++ = keys[(last < size ? last : size) - 1];
+  }
+}
+} // namespace bimap_impl
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace bimap_impl {
+// Operation counters of treaps and bimaps are kept only when BIMAP_STATS is
+// defined; otherwise they are compiled out and take no space. It must be set
+// the same way in every translation unit.
+//
+// Relaxed atomic counter: parallel set operations update the counters of
+// one treap from several threads. A copy starts from zero, since counters
+// describe the operations of one object.
+class stat_counter {
+public:
+  stat_counter() noexcept = default;
+
+  stat_counter(const stat_counter&) noexcept {}
+
+  stat_counter& operator=(const stat_counter&) noexcept {
+    return *this;
+  }
+
+  void add(size_t n = 1) const noexcept {
+    value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  size_t load() const noexcept {
+    return value.load(std::memory_order_relaxed);
+  }
+
+  void reset() const noexcept {
+    value.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  mutable std::atomic<size_t> value{0};
+};
+
+struct treap_counters {
+  stat_counter compares;
+  stat_counter searches;
+  stat_counter search_steps;
+  stat_counter splits;
+  stat_counter merges;
+};
+
+// Snapshot of the counters of a treap together with its shape.
+struct treap_stats {
+  size_t compares = 0;
+  // descents looking for a key, and the nodes they passed
+  size_t searches = 0;
+  size_t search_steps = 0;
+  size_t splits = 0;
+  size_t merges = 0;
+  // depth_histogram[d] is the number of nodes at depth d, the root is at 0
+  std::vector<size_t> depth_histogram;
+
+  double average_search_path() const noexcept {
+    return searches ? double(search_steps) / double(searches) : 0;
+  }
+
+  double average_depth() const noexcept {
+    size_t nodes = 0;
+    size_t total = 0;
+    for (size_t d = 0; d < depth_histogram.size(); ++d) {
+      nodes += depth_histogram[d];
+      total += d * depth_histogram[d];
+    }
+    return nodes ? double(total) / double(nodes) : 0;
+  }
+
+  size_t height() const noexcept {
+    return depth_histogram.size();
+  }
+};
+
+struct bimap_stats {
+  treap_stats left;
+  treap_stats right;
+  size_t allocations = 0;
+  size_t deallocations = 0;
+};
+} // namespace bimap_impl
@@ -1,6 +1,22 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
 #include <random>
+#include <string>
+#include <string_view>
+#include <thread>
 
 #include "bimap.h"
+#include "concurrent_bimap.h"
+#include "flat_bimap.h"
+#include "mapped_bimap.h"
+#include "multi_index.h"
+#include "persistent_bimap.h"
+#include "unordered_bimap.h"
 #include "test-classes.h"
 #include "gtest/gtest.h"
 
@@ -334,6 +350,1270 @@ TEST(bimap, swap) {
   EXPECT_EQ(*b.find_right(3), 3);
 }
 
+TEST(bimap, order_statistics) {
+  bimap<int, int> b;
+  for (int i = 0; i < 10; i++) {
+    b.insert(i * 10, 100 - i);
+  }
+
+  EXPECT_EQ(*b.nth_left(0), 0);
+  EXPECT_EQ(*b.nth_left(7), 70);
+  EXPECT_EQ(b.nth_left(10), b.end_left());
+  EXPECT_EQ(*b.nth_right(0), 91);
+  EXPECT_EQ(*b.nth_right(9).flip(), 0);
+
+  EXPECT_EQ(b.rank_left(-5), 0);
+  EXPECT_EQ(b.rank_left(30), 3);
+  EXPECT_EQ(b.rank_left(35), 4);
+  EXPECT_EQ(b.rank_right(1000), 10);
+
+  EXPECT_EQ(b.count_range_left(10, 50), 4);
+  EXPECT_EQ(b.count_range_left(15, 15), 0);
+  EXPECT_EQ(b.count_range_left(50, 10), 0);
+  EXPECT_EQ(b.count_range_right(95, 1000), 6);
+
+  b.erase_left(30);
+  EXPECT_EQ(*b.nth_left(3), 40);
+  EXPECT_EQ(b.rank_left(35), 3);
+}
+
+TEST(bimap, iterator_arithmetic) {
+  bimap<int, int> b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, -i);
+  }
+
+  auto it = b.begin_left() + 42;
+  EXPECT_EQ(*it, 42);
+  EXPECT_EQ(*(it - 40), 2);
+  EXPECT_EQ(*(8 + it), 50);
+  EXPECT_EQ(it[10], 52);
+  EXPECT_EQ(b.begin_left() + 100, b.end_left());
+  EXPECT_EQ(*(b.end_left() - 1), 99);
+
+  EXPECT_EQ(b.end_left() - b.begin_left(), 100);
+  EXPECT_EQ(b.begin_left() - it, -42);
+  EXPECT_EQ(std::distance(b.begin_right(), b.end_right()), 100);
+  EXPECT_EQ(std::distance(b.begin_right(), it.flip()), 57);
+  EXPECT_EQ(*std::next(b.begin_right(), 3), -96);
+
+  it += 7;
+  EXPECT_EQ(*it, 49);
+  it -= 49;
+  EXPECT_EQ(it, b.begin_left());
+
+  EXPECT_LT(b.begin_left(), b.end_left());
+  EXPECT_LE(it, b.begin_left());
+  EXPECT_GT(b.end_right(), b.begin_right() + 99);
+  EXPECT_TRUE(std::is_sorted(b.begin_left(), b.end_left()));
+}
+
+namespace {
+struct counted_key {
+  static inline size_t constructed = 0;
+
+  explicit counted_key(int value) : value(value) {
+    constructed++;
+  }
+  counted_key(counted_key const &other) : value(other.value) {
+    constructed++;
+  }
+
+  int value;
+};
+
+struct counted_key_compare {
+  using is_transparent = void;
+
+  static int value(counted_key const &key) {
+    return key.value;
+  }
+  static int value(int key) {
+    return key;
+  }
+
+  template <typename A, typename B>
+  bool operator()(A const &a, B const &b) const {
+    return value(a) < value(b);
+  }
+};
+} // namespace
+
+TEST(bimap, transparent_lookup) {
+  bimap<std::string, int, std::less<>> b;
+  b.insert("alpha", 1);
+  b.insert("beta", 2);
+  b.insert("gamma", 3);
+
+  std::string_view key = "beta";
+  EXPECT_EQ(*b.find_left(key), "beta");
+  EXPECT_EQ(b.at_left("gamma"), 3);
+  EXPECT_EQ(b.find_left("delta"), b.end_left());
+  EXPECT_EQ(*b.lower_bound_left("b"), "beta");
+  EXPECT_EQ(*b.upper_bound_left(key), "gamma");
+  EXPECT_EQ(b.rank_left("c"), 2);
+  EXPECT_EQ(b.count_range_left("a", "c"), 2);
+
+  bimap<int, counted_key, std::less<int>, counted_key_compare> c;
+  c.insert(1, counted_key(10));
+  c.insert(2, counted_key(20));
+
+  counted_key::constructed = 0;
+  EXPECT_EQ(c.at_right(20), 2);
+  EXPECT_EQ(c.find_right(30), c.end_right());
+  EXPECT_EQ(c.lower_bound_right(15).flip(), c.find_left(2));
+  EXPECT_EQ(c.count_range_right(0, 100), 2);
+  EXPECT_EQ(counted_key::constructed, 0);
+}
+
+TEST(bimap, merge) {
+  bimap<int, int> a, b;
+  a.insert(1, 10);
+  a.insert(2, 20);
+  a.insert(3, 30);
+  b.insert(0, 0);
+  b.insert(2, 21);
+  b.insert(4, 30);
+  auto moved = b.insert(5, 50);
+  b.insert(6, 60);
+
+  a.merge(b);
+  EXPECT_EQ(a.size(), 6);
+  EXPECT_EQ(b.size(), 2);
+  EXPECT_EQ(a.at_left(2), 20);
+  EXPECT_EQ(a.at_left(0), 0);
+  EXPECT_EQ(a.at_right(30), 3);
+  EXPECT_EQ(b.at_left(2), 21);
+  EXPECT_EQ(b.at_left(4), 30);
+  EXPECT_EQ(*moved.flip(), 50);
+  EXPECT_EQ(moved, a.find_left(5));
+  EXPECT_EQ(std::distance(a.begin_right(), a.end_right()), 6);
+
+  a.merge(std::move(b));
+  EXPECT_EQ(a.size(), 6);
+}
+
+TEST(bimap, extract_range) {
+  bimap<int, int> b;
+  for (int i = 0; i < 10; i++) {
+    b.insert(i, 9 - i);
+  }
+
+  auto middle = b.extract_range_left(b.find_left(3), b.find_left(7));
+  EXPECT_EQ(b.size(), 6);
+  EXPECT_EQ(middle.size(), 4);
+  EXPECT_EQ(*middle.begin_left(), 3);
+  EXPECT_EQ(*middle.begin_right(), 3);
+  EXPECT_EQ(middle.at_right(6), 3);
+  EXPECT_EQ(b.find_right(4), b.end_right());
+  EXPECT_EQ(*(b.begin_left() + 3), 7);
+
+  auto tail = b.extract_range_right(b.find_right(1), b.end_right());
+  EXPECT_EQ(tail.size(), 5);
+  EXPECT_EQ(b.size(), 1);
+  EXPECT_EQ(b.at_left(9), 0);
+
+  auto empty = b.extract_range_left(b.begin_left(), b.begin_left());
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(b.size(), 1);
+}
+
+TEST(bimap, subtract_intersect) {
+  bimap<int, int> a, b;
+  for (int i = 0; i < 10; i++) {
+    a.insert(i, i);
+  }
+  b.insert(2, 2);
+  b.insert(3, 4);
+  b.insert(7, 7);
+  b.insert(100, 100);
+
+  auto c = a;
+  c.intersect(b);
+  EXPECT_EQ(c.size(), 2);
+  EXPECT_EQ(c.at_left(2), 2);
+  EXPECT_EQ(c.at_right(7), 7);
+
+  a.subtract(b);
+  EXPECT_EQ(a.size(), 8);
+  EXPECT_EQ(a.find_left(2), a.end_left());
+  EXPECT_EQ(a.at_left(3), 3);
+  EXPECT_EQ(a.find_right(7), a.end_right());
+
+  a.subtract(a);
+  EXPECT_TRUE(a.empty());
+}
+
+TEST(bimap, size_policies) {
+  using pairs = std::allocator<std::pair<int, int>>;
+  using compact = bimap<int, int, std::less<int>, std::less<int>, pairs,
+                        bimap_impl::subtree_sizes<uint32_t>>;
+  using unsized = bimap<int, int, std::less<int>, std::less<int>, pairs,
+                        bimap_impl::no_subtree_sizes>;
+  static_assert(sizeof(compact::binode_t) < sizeof(bimap<int, int>::binode_t));
+  static_assert(sizeof(unsized::binode_t) < sizeof(compact::binode_t));
+  static_assert(std::is_same_v<unsized::left_iterator::iterator_category,
+                               std::bidirectional_iterator_tag>);
+
+  compact c;
+  for (int i = 0; i < 10; i++) {
+    c.insert(i, -i);
+  }
+  EXPECT_EQ(*c.nth_left(3), 3);
+  EXPECT_EQ(c.rank_right(-5), 4);
+  EXPECT_EQ(c.end_left() - c.begin_left(), 10);
+
+  unsized a, b;
+  for (int i = 0; i < 10; i++) {
+    a.insert(i, i);
+    b.insert(i + 5, -i);
+  }
+  EXPECT_EQ(a.size(), 10);
+  EXPECT_TRUE(a.erase_left(0));
+  EXPECT_EQ(a.size(), 9);
+
+  auto middle = a.extract_range_left(a.find_left(3), a.find_left(7));
+  EXPECT_EQ(middle.size(), 4);
+  EXPECT_EQ(a.size(), 5);
+
+  a.merge(b);
+  EXPECT_EQ(a.size(), 12);
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(std::distance(a.begin_right(), a.end_right()), 12);
+
+  unsized copy = a;
+  copy.subtract(b);
+  EXPECT_EQ(copy.size(), 12);
+  copy.intersect(middle);
+  EXPECT_TRUE(copy.empty());
+  EXPECT_EQ(a.size(), 12);
+  a.clear();
+  EXPECT_TRUE(a.empty());
+}
+
+TEST(bimap, priority_source) {
+  bimap_impl::priority_source a(uint64_t(42)), b(uint64_t(42)),
+      c(uint64_t(43));
+  std::vector<size_t> seq_a, seq_b, seq_c;
+  for (int i = 0; i < 100; i++) {
+    seq_a.push_back(a());
+    seq_b.push_back(b());
+    seq_c.push_back(c());
+  }
+  EXPECT_EQ(seq_a, seq_b);
+  EXPECT_NE(seq_a, seq_c);
+
+  a.seed(42);
+  EXPECT_EQ(a(), seq_a[0]);
+
+  bimap<int, int> m;
+  m.reseed(7);
+  for (int i = 0; i < 1000; i++) {
+    m.insert(i, -i);
+  }
+  EXPECT_EQ(m.size(), 1000);
+  EXPECT_EQ(m.at_right(-999), 999);
+}
+
+TEST(bimap, slab_allocator) {
+  using slab_bimap = bimap<int, int, std::less<int>, std::less<int>,
+                           bimap_impl::slab_allocator<std::pair<int, int>>>;
+  slab_bimap b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, -i);
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    EXPECT_TRUE(b.erase_left(i));
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    b.insert(i, -i);
+  }
+  EXPECT_EQ(b.size(), 1000);
+
+  slab_bimap copy = b;
+  EXPECT_EQ(copy, b);
+  EXPECT_NE(copy.get_allocator(), b.get_allocator());
+
+  slab_bimap moved = std::move(copy);
+  copy = b;
+  moved.erase_left(0);
+  EXPECT_EQ(copy.at_left(0), 0);
+  EXPECT_EQ(moved.size(), 999);
+
+  moved.swap(b);
+  EXPECT_EQ(b.size(), 999);
+  EXPECT_EQ(moved.at_right(-999), 999);
+}
+
+TEST(bimap, slab_allocator_many_sizes) {
+  struct alignas(64) wide {
+    int value;
+  };
+
+  bimap_impl::slab_allocator<int> ints;
+  bimap_impl::slab_allocator<wide> wides(ints);
+  std::vector<std::pair<int*, size_t>> blocks;
+  for (size_t n = 1; n <= 64; n++) {
+    int* block = ints.allocate(n);
+    std::fill(block, block + n, int(n));
+    blocks.emplace_back(block, n);
+  }
+  wide* aligned = wides.allocate(3);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 64, 0);
+  for (auto [block, n] : blocks) {
+    EXPECT_EQ(std::count(block, block + n, int(n)), n);
+  }
+  for (size_t i = 0; i < blocks.size(); i += 2) {
+    ints.deallocate(blocks[i].first, blocks[i].second);
+  }
+  wides.deallocate(aligned, 3);
+
+  std::vector<int, bimap_impl::slab_allocator<int>> v(ints);
+  for (int i = 0; i < 100000; i++) {
+    v.push_back(i);
+  }
+  EXPECT_EQ(v[99999], 99999);
+  v = std::vector<int, bimap_impl::slab_allocator<int>>(ints);
+
+  bimap_impl::slab_allocator<int> unique;
+  unique.allocate(1000);
+  unique.allocate(2000);
+  EXPECT_TRUE(unique.reset_if_unique());
+  EXPECT_NE(unique.allocate(3000), nullptr);
+}
+
+TEST(bimap, clear) {
+  bimap<std::string, int> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(std::to_string(i), i);
+  }
+  b.clear();
+  EXPECT_TRUE(b.empty());
+  EXPECT_EQ(b.begin_left(), b.end_left());
+  EXPECT_EQ(b.begin_right(), b.end_right());
+  b.insert("1", 1);
+  EXPECT_EQ(b.at_right(1), "1");
+
+  using slab_bimap = bimap<int, int, std::less<int>, std::less<int>,
+                           bimap_impl::slab_allocator<std::pair<int, int>>>;
+  slab_bimap s;
+  for (int i = 0; i < 1000; i++) {
+    s.insert(i, -i);
+  }
+  slab_bimap shared({}, {}, s.get_allocator());
+  shared.insert(1, 1);
+  s.clear();
+  EXPECT_TRUE(s.empty());
+  EXPECT_EQ(shared.at_left(1), 1);
+
+  shared.clear();
+  for (int i = 0; i < 1000; i++) {
+    shared.insert(i, i);
+  }
+  EXPECT_EQ(shared.size(), 1000);
+  EXPECT_EQ(shared.at_right(999), 999);
+
+  slab_bimap unique;
+  for (int i = 0; i < 1000; i++) {
+    unique.insert(i, i);
+  }
+  unique.clear();
+  EXPECT_TRUE(unique.empty());
+  unique.insert(2, 3);
+  EXPECT_EQ(unique.at_left(2), 3);
+}
+
+TEST(bimap, node_handle) {
+  bimap<std::string, int> a;
+  bimap<std::string, int> b;
+  a.insert("one", 1);
+  a.insert("two", 2);
+  a.insert("three", 3);
+  b.insert("two", 20);
+
+  auto node = a.extract_left(a.find_left("one"));
+  EXPECT_FALSE(node.empty());
+  EXPECT_EQ(node.left(), "one");
+  EXPECT_EQ(node.right(), 1);
+  EXPECT_EQ(a.size(), 2);
+  EXPECT_EQ(a.find_right(1), a.end_right());
+
+  const std::string* key = &node.left();
+  auto it = b.insert(std::move(node));
+  EXPECT_TRUE(node.empty());
+  EXPECT_EQ(&*it, key);
+  EXPECT_EQ(b.at_right(1), "one");
+
+  node = a.extract_right(2);
+  EXPECT_EQ(b.insert(std::move(node)), b.end_left());
+  EXPECT_FALSE(node.empty());
+  node.left() = "zwei";
+  EXPECT_NE(b.insert(std::move(node)), b.end_left());
+  EXPECT_EQ(b.at_left("zwei"), 2);
+  EXPECT_TRUE(a.extract_left("none").empty());
+
+  node = a.extract_left("three");
+  EXPECT_TRUE(a.empty());
+}
+
+TEST(bimap, replace) {
+  bimap<int, int> b;
+  for (int i = 0; i < 10; i++) {
+    b.insert(i, i * 10);
+  }
+
+  auto it = b.find_left(3);
+  EXPECT_TRUE(b.replace_right(it, 1000));
+  EXPECT_EQ(b.at_left(3), 1000);
+  EXPECT_EQ(b.find_right(30), b.end_right());
+  EXPECT_EQ(it.flip(), --b.end_right());
+  EXPECT_EQ(it.flip().flip(), it);
+
+  EXPECT_FALSE(b.replace_right(it, 40));
+  EXPECT_TRUE(b.replace_right(it, 1000));
+  EXPECT_TRUE(b.replace_left(b.find_right(0), -1));
+  EXPECT_EQ(*b.begin_left(), -1);
+  EXPECT_EQ(b.size(), 10);
+}
+
+TEST(bimap, emplace) {
+  bimap<std::string, std::string> b;
+  auto it = b.emplace(std::piecewise_construct, std::forward_as_tuple(3, 'a'),
+                      std::forward_as_tuple("right"));
+  EXPECT_EQ(*it, "aaa");
+  EXPECT_EQ(*it.flip(), "right");
+  EXPECT_EQ(b.emplace("aaa", "other"), b.end_left());
+  EXPECT_EQ(b.emplace("bbb", "right"), b.end_left());
+  EXPECT_EQ(b.size(), 1);
+
+  std::string key = "aaa";
+  EXPECT_EQ(b.try_emplace_left(std::move(key), 5, 'x'), b.end_left());
+  EXPECT_EQ(key, "aaa");
+  b.try_emplace_left(std::string("ccc"), 2, 'y');
+  EXPECT_EQ(b.at_left("ccc"), "yy");
+  EXPECT_EQ(*b.try_emplace_right("zz", "ddd"), "ddd");
+  EXPECT_EQ(b.try_emplace_right("right", "eee"), b.end_left());
+  EXPECT_EQ(b.try_emplace_left("eee", "yy"), b.end_left());
+  EXPECT_EQ(b.size(), 3);
+}
+
+TEST(bimap, insert_copies) {
+  struct counted {
+    int value;
+    int* copies;
+    int* moves;
+
+    counted(int value, int* copies, int* moves)
+        : value(value), copies(copies), moves(moves) {}
+    counted(counted const& other)
+        : value(other.value), copies(other.copies), moves(other.moves) {
+      ++*copies;
+    }
+    counted(counted&& other) noexcept
+        : value(other.value), copies(other.copies), moves(other.moves) {
+      ++*moves;
+    }
+
+    bool operator<(counted const& other) const {
+      return value < other.value;
+    }
+  };
+
+  int copies = 0;
+  int moves = 0;
+  bimap<counted, int> b;
+  counted x(1, &copies, &moves);
+  b.insert(x, 1);
+  EXPECT_EQ(copies, 1);
+  EXPECT_EQ(moves, 0);
+  b.insert(counted(2, &copies, &moves), 2);
+  EXPECT_EQ(copies, 1);
+  EXPECT_EQ(moves, 1);
+  b.insert(x, 3);
+  b.insert(counted(3, &copies, &moves), 2);
+  EXPECT_EQ(copies, 1);
+  EXPECT_EQ(moves, 1);
+  b.emplace(std::piecewise_construct, std::forward_as_tuple(4, &copies, &moves),
+            std::forward_as_tuple(4));
+  EXPECT_EQ(copies, 1);
+  EXPECT_EQ(moves, 1);
+  EXPECT_EQ(b.size(), 3);
+}
+
+TEST(bimap, insert_hint) {
+  bimap<int, int> b;
+  auto hint = b.end_left();
+  for (int i = 0; i < 1000; i++) {
+    hint = b.insert(hint, i, 1000 - i);
+  }
+  for (int i = -1; i > -1000; i--) {
+    hint = b.insert(hint, i, -i + 2000);
+  }
+  EXPECT_EQ(b.size(), 1999);
+  EXPECT_EQ(*b.begin_left(), -999);
+  EXPECT_EQ(b.at_right(1000), 0);
+
+  EXPECT_EQ(b.insert(b.begin_left(), 500, 1), b.end_left());
+  EXPECT_EQ(b.insert(b.nth_left(1500), -3, 5000), b.end_left());
+  EXPECT_EQ(*b.insert(b.nth_left(10), 5000, 5000).flip(), 5000);
+  EXPECT_EQ(b.size(), 2000);
+}
+
+#ifdef BIMAP_STATS
+TEST(bimap, stats) {
+  bimap<int, int> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, -i);
+  }
+  b.erase_left(10);
+
+  auto stats = b.stats();
+  EXPECT_EQ(stats.allocations, 1000);
+  EXPECT_EQ(stats.deallocations, 1);
+  EXPECT_EQ(stats.left.searches, 1001);
+  EXPECT_GT(stats.left.compares, stats.left.search_steps);
+  EXPECT_GE(stats.left.merges, 1);
+  EXPECT_EQ(stats.left.splits, 0);
+  EXPECT_GT(stats.left.average_search_path(), 1);
+
+  size_t nodes = 0;
+  for (size_t count : stats.right.depth_histogram) {
+    nodes += count;
+  }
+  EXPECT_EQ(nodes, 999);
+  EXPECT_EQ(stats.right.depth_histogram[0], 1);
+  EXPECT_LT(stats.right.height(), 50);
+  EXPECT_GT(stats.right.average_depth(), 1);
+
+  b.reset_stats();
+  b.find_right(-5);
+  stats = b.stats();
+  EXPECT_EQ(stats.right.searches, 1);
+  EXPECT_EQ(stats.left.searches, 0);
+  EXPECT_EQ(stats.allocations, 0);
+
+  b.clear();
+  EXPECT_EQ(b.stats().deallocations, 999);
+}
+#endif
+
+TEST(bimap, find_batch) {
+  bimap<int, std::string> b;
+  std::vector<int> keys;
+  std::vector<bimap<int, std::string>::left_iterator> found(3);
+  EXPECT_EQ(b.find_left_batch(keys.begin(), keys.end(), found.begin()),
+            found.begin());
+
+  keys = {1, 2, 3};
+  b.find_left_batch(keys.begin(), keys.end(), found.begin());
+  EXPECT_EQ(found[2], b.end_left());
+
+  for (int i = 0; i < 100; i += 2) {
+    b.insert(i, std::to_string(i));
+  }
+  keys.clear();
+  for (int i = 99; i >= -3; i--) {
+    keys.push_back(i);
+  }
+  found.resize(keys.size());
+  auto end = b.find_left_batch(keys.begin(), keys.end(), found.begin());
+  EXPECT_EQ(end, found.end());
+  for (size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(found[i], b.find_left(keys[i]));
+  }
+
+  std::vector<std::string> rights = {"4", "5", "98", ""};
+  std::vector<bimap<int, std::string>::right_iterator> found_right(4);
+  b.find_right_batch(rights.begin(), rights.end(), found_right.begin());
+  EXPECT_EQ(*found_right[0].flip(), 4);
+  EXPECT_EQ(found_right[1], b.end_right());
+  EXPECT_EQ(*found_right[2].flip(), 98);
+  EXPECT_EQ(found_right[3], b.end_right());
+}
+
+TEST(bimap, from_sorted) {
+  std::vector<std::pair<int, int>> data = {
+      {1, 10}, {2, 20}, {2, 30}, {3, 10}, {4, 40}, {5, 5}, {6, 40}};
+
+  bimap<int, int> expected;
+  for (auto const &p : data) {
+    expected.insert(p.first, p.second);
+  }
+
+  auto b = bimap<int, int>::from_sorted(data.begin(), data.end());
+  EXPECT_EQ(b.size(), 4);
+  EXPECT_EQ(b, expected);
+  EXPECT_EQ(*b.begin_right(), 5);
+  EXPECT_EQ(b.at_right(40), 4);
+
+  b.insert(0, 0);
+  b.assign_sorted(data.begin() + 3, data.end());
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(b.find_left(0), b.end_left());
+  EXPECT_EQ(b.at_left(3), 10);
+}
+
+TEST(bimap, from_sorted_move) {
+  std::vector<std::pair<test_object, int>> data;
+  for (int i = 0; i < 3; i++) {
+    data.emplace_back(test_object(i + 1), i);
+  }
+
+  auto b = bimap<test_object, int>::from_sorted(
+      std::make_move_iterator(data.begin()),
+      std::make_move_iterator(data.end()));
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(data[0].first.a, 0);
+  EXPECT_EQ(b.at_right(2), test_object(3));
+}
+
+TEST(flat_bimap, simple) {
+  flat_bimap<int, int> b;
+  EXPECT_EQ(*b.insert(4, 40), 4);
+  EXPECT_EQ(*b.insert(1, 30), 1);
+  EXPECT_EQ(*b.insert(3, 10), 3);
+  auto it = b.insert(3, 20);
+  EXPECT_EQ(it, b.end_left());
+  it = b.insert(2, 10);
+  EXPECT_EQ(it, b.end_left());
+  EXPECT_EQ(b.size(), 3);
+
+  EXPECT_EQ(b.at_left(1), 30);
+  EXPECT_EQ(b.at_right(40), 4);
+  EXPECT_THROW(b.at_left(2), std::out_of_range);
+  EXPECT_EQ(*b.find_right(10).flip(), 3);
+  EXPECT_EQ(b.find_left(2), b.end_left());
+  EXPECT_EQ(b.end_left().flip(), b.end_right());
+
+  EXPECT_EQ(b.begin_left()[2], 4);
+  EXPECT_EQ(b.end_right() - b.begin_right(), 3);
+  EXPECT_EQ(*b.lower_bound_right(11), 30);
+  EXPECT_EQ(*b.upper_bound_left(3), 4);
+  EXPECT_EQ(b.rank_right(30), 1);
+  EXPECT_EQ(b.count_range_left(2, 5), 2);
+
+  EXPECT_EQ(b.at_left_or_default(2), 0);
+  EXPECT_EQ(b.at_right_or_default(40), 4);
+  EXPECT_EQ(b.size(), 4);
+
+  EXPECT_TRUE(b.erase_right(10));
+  EXPECT_FALSE(b.erase_left(3));
+  EXPECT_EQ(*b.erase_left(b.find_left(1)), 2);
+  EXPECT_EQ(b.size(), 2);
+  EXPECT_EQ(b.at_right(0), 2);
+  EXPECT_EQ(b.at_left(4), 40);
+
+  flat_bimap<int, int> copy = b;
+  EXPECT_EQ(copy, b);
+  copy.erase_right(copy.begin_right(), copy.end_right());
+  EXPECT_TRUE(copy.empty());
+  EXPECT_NE(copy, b);
+
+  flat_bimap<std::string, int> s;
+  s.insert("b", 1);
+  s.insert("a", 2);
+  EXPECT_EQ(s.at_right(1), "b");
+  EXPECT_EQ(*s.upper_bound_left("a"), "b");
+  EXPECT_EQ(s.find_left("c"), s.end_left());
+}
+
+struct wide_key {
+  int64_t major;
+  int64_t minor;
+  int64_t payload;
+
+  bool operator<(const wide_key& other) const noexcept {
+    return major != other.major ? major < other.major : minor < other.minor;
+  }
+
+  bool operator==(const wide_key& other) const noexcept {
+    return major == other.major && minor == other.minor;
+  }
+};
+
+TEST(flat_bimap, odd_key_size) {
+  static_assert(bimap_impl::cache_line % sizeof(wide_key) != 0);
+  flat_bimap<wide_key, int> f;
+  bimap<wide_key, int> b;
+  std::mt19937 e(42);
+  for (int i = 0; i < 2000; i++) {
+    wide_key key{int64_t(e() % 50), int64_t(e() % 100), i};
+    if (i % 5 == 4) {
+      EXPECT_EQ(f.erase_left(key), b.erase_left(key));
+    } else {
+      auto it = f.insert(key, i);
+      EXPECT_EQ(it == f.end_left(), b.insert(key, i) == b.end_left());
+    }
+  }
+
+  auto frozen = b.freeze();
+  ASSERT_EQ(f.size(), b.size());
+  for (int64_t major = -1; major <= 50; major++) {
+    for (int64_t minor = -1; minor <= 100; minor += 7) {
+      wide_key key{major, minor, 0};
+      auto expected = b.lower_bound_left(key) - b.begin_left();
+      EXPECT_EQ(f.lower_bound_left(key) - f.begin_left(), expected);
+      EXPECT_EQ(frozen.lower_bound_left(key) - frozen.begin_left(), expected);
+      EXPECT_EQ(f.upper_bound_left(key) - f.begin_left(),
+                b.upper_bound_left(key) - b.begin_left());
+    }
+  }
+}
+
+TEST(bimap, freeze) {
+  bimap<int, uint32_t> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i * 3 - 1500, uint32_t(i * 7919 % 1000) * 5 + 2147483000u);
+  }
+
+  auto f = b.freeze();
+  EXPECT_EQ(f.size(), b.size());
+  for (int i = -1502; i < 1502; i++) {
+    auto it = f.find_left(i);
+    auto expected = b.find_left(i);
+    ASSERT_EQ(it == f.end_left(), expected == b.end_left());
+    EXPECT_EQ(f.lower_bound_left(i) - f.begin_left(),
+              b.lower_bound_left(i) - b.begin_left());
+    EXPECT_EQ(f.upper_bound_left(i) - f.begin_left(),
+              b.upper_bound_left(i) - b.begin_left());
+    if (it != f.end_left()) {
+      EXPECT_EQ(*it.flip(), *expected.flip());
+      EXPECT_EQ(f.at_right(*it.flip()), i);
+    }
+  }
+
+  for (auto it = b.begin_right(); it != b.end_right(); ++it) {
+    for (uint32_t key : {*it - 1, *it, *it + 1}) {
+      EXPECT_EQ(f.lower_bound_right(key) - f.begin_right(),
+                b.lower_bound_right(key) - b.begin_right());
+      EXPECT_EQ(f.upper_bound_right(key) - f.begin_right(),
+                b.upper_bound_right(key) - b.begin_right());
+    }
+  }
+  EXPECT_THROW(f.at_left(1), std::out_of_range);
+  EXPECT_EQ(f.end_right().flip(), f.end_left());
+
+  auto copy = f;
+  EXPECT_EQ(copy, f);
+  frozen_bimap<int, uint32_t> empty;
+  EXPECT_NE(empty, f);
+  empty = std::move(copy);
+  EXPECT_EQ(empty, f);
+  EXPECT_TRUE(copy.empty());
+
+  bimap<std::string, int> s;
+  s.insert("b", 1);
+  s.insert("a", 2);
+  auto fs = s.freeze();
+  EXPECT_EQ(fs.at_right(1), "b");
+  EXPECT_EQ(*fs.begin_left(), "a");
+  EXPECT_EQ(fs.find_left("c"), fs.end_left());
+}
+
+template <typename Key>
+void check_frozen_bounds(std::vector<Key> const& keys) {
+  bimap<Key, int> b;
+  for (size_t i = 0; i < keys.size(); i++) {
+    b.insert(keys[i], int(i));
+  }
+
+  auto f = b.freeze();
+  for (Key key : keys) {
+    for (Key probe : {Key(key - 1), key, Key(key + 1)}) {
+      EXPECT_EQ(f.lower_bound_left(probe) - f.begin_left(),
+                b.lower_bound_left(probe) - b.begin_left());
+      EXPECT_EQ(f.upper_bound_left(probe) - f.begin_left(),
+                b.upper_bound_left(probe) - b.begin_left());
+    }
+  }
+}
+
+TEST(bimap, freeze_integer_keys) {
+  std::mt19937_64 e(42);
+  std::vector<int64_t> wide(500);
+  for (auto& key : wide) {
+    key = int64_t(e());
+  }
+  check_frozen_bounds(wide);
+  check_frozen_bounds(std::vector<uint64_t>(wide.begin(), wide.end()));
+  check_frozen_bounds(std::vector<uint32_t>(wide.begin(), wide.end()));
+
+  std::vector<int16_t> narrow;
+  for (int i = -32768; i < 32768; i += 97) {
+    narrow.push_back(int16_t(i));
+  }
+  check_frozen_bounds(narrow);
+  check_frozen_bounds(std::vector<uint16_t>(narrow.begin(), narrow.end()));
+  check_frozen_bounds(std::vector<int8_t>(narrow.begin(), narrow.begin() + 256));
+  check_frozen_bounds(std::vector<uint8_t>(narrow.begin(), narrow.begin() + 256));
+}
+
+TEST(bimap, mapped) {
+  bimap<int64_t, uint32_t> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(int64_t(i) * i - 5000, uint32_t(i * 7919 % 1000));
+  }
+
+  std::string path = testing::TempDir() + "bimap_mapped_test.bin";
+  mapped_bimap<int64_t, uint32_t>::write(b.freeze(), path);
+  {
+    mapped_bimap<int64_t, uint32_t> m(path);
+    EXPECT_EQ(m.size(), b.size());
+    EXPECT_EQ(m.at_right(7919 % 1000), -4999);
+    EXPECT_EQ(*m.lower_bound_left(-4000), b.lower_bound_left(-4000)[0]);
+    EXPECT_EQ(m.find_left(-4000), m.end_left());
+
+    auto it = m.begin_right();
+    for (auto expected = b.begin_right(); expected != b.end_right();
+         ++expected, ++it) {
+      EXPECT_EQ(*it, *expected);
+      EXPECT_EQ(*it.flip(), *expected.flip());
+    }
+
+    auto moved = std::move(m);
+    EXPECT_EQ(moved.at_left(-5000), 0);
+    EXPECT_TRUE(m.empty());
+  }
+
+  {
+    // a rewrite replaces the file, the old mapping keeps the old pairs
+    mapped_bimap<int64_t, uint32_t> old(path);
+    bimap<int64_t, uint32_t> other;
+    other.insert(1, 2);
+    mapped_bimap<int64_t, uint32_t>::write(other, path);
+    EXPECT_EQ(old.size(), b.size());
+    EXPECT_EQ(old.at_left(-5000), 0);
+    EXPECT_EQ((mapped_bimap<int64_t, uint32_t>(path).at_left(1)), 2);
+  }
+
+  {
+    // concurrent writers use their own temporary files
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 2; t++) {
+      writers.emplace_back([&, t] {
+        for (int i = 0; i < 20; i++) {
+          bimap<int64_t, uint32_t> pairs;
+          pairs.insert(t, uint32_t(i));
+          mapped_bimap<int64_t, uint32_t>::write(pairs, path);
+        }
+      });
+    }
+    for (auto& writer : writers) {
+      writer.join();
+    }
+    EXPECT_EQ((mapped_bimap<int64_t, uint32_t>(path).at_right(19) < 2), true);
+
+    size_t leftovers = 0;
+    for (auto& entry : std::filesystem::directory_iterator(testing::TempDir())) {
+      auto name = entry.path().filename().string();
+      leftovers += name.rfind("bimap_mapped_test.bin.", 0) == 0;
+    }
+    EXPECT_EQ(leftovers, 0);
+  }
+
+  // corrupt arrays are rejected at open instead of read out of bounds
+  auto corrupt = [&](auto offset_of, auto value) {
+    mapped_bimap<int64_t, uint32_t>::write(b, path);
+    bimap_impl::mapped_header header;
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    file.seekp(offset_of(header));
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  corrupt([](auto& h) { return h.right.partner + 4 * sizeof(uint32_t); },
+          uint32_t(5000));
+  EXPECT_THROW((mapped_bimap<int64_t, uint32_t>(path)), std::runtime_error);
+  corrupt([](auto& h) { return h.right.partner; }, uint32_t(1));
+  EXPECT_THROW((mapped_bimap<int64_t, uint32_t>(path)), std::runtime_error);
+  corrupt([](auto& h) { return h.left.keys; }, int64_t(100000));
+  EXPECT_THROW((mapped_bimap<int64_t, uint32_t>(path)), std::runtime_error);
+  corrupt([](auto& h) { return h.left.summary; }, int64_t(-4999));
+  EXPECT_THROW((mapped_bimap<int64_t, uint32_t>(path)), std::runtime_error);
+
+  {
+    // offsets pointing out of the file are rejected, not read
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    uint64_t offset = uint64_t(1) << 40;
+    file.seekp(offsetof(bimap_impl::mapped_header, right) +
+               offsetof(bimap_impl::mapped_header::side, partner));
+    file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+  }
+  EXPECT_THROW((mapped_bimap<int64_t, uint32_t>(path)), std::runtime_error);
+
+  mapped_bimap<int64_t, uint32_t>::write(bimap<int64_t, uint32_t>(), path);
+  EXPECT_TRUE((mapped_bimap<int64_t, uint32_t>(path).empty()));
+  EXPECT_THROW((mapped_bimap<int32_t, uint32_t>(path)), std::runtime_error);
+  EXPECT_THROW((mapped_bimap<int64_t, uint32_t>(path + ".missing")),
+               std::system_error);
+  std::remove(path.c_str());
+}
+
+TEST(unordered_bimap, simple) {
+  unordered_bimap<int, std::string> b;
+  EXPECT_EQ(*b.insert(1, "one"), 1);
+  EXPECT_EQ(*b.insert(2, "two"), 2);
+  auto it = b.insert(3, "one");
+  EXPECT_EQ(it, b.end_left());
+  it = b.insert(1, "uno");
+  EXPECT_EQ(it, b.end_left());
+  EXPECT_EQ(b.size(), 2);
+
+  EXPECT_EQ(b.at_left(2), "two");
+  EXPECT_EQ(b.at_right("one"), 1);
+  EXPECT_THROW(b.at_left(3), std::out_of_range);
+  EXPECT_EQ(*b.find_right("two").flip(), 2);
+  EXPECT_EQ(b.find_left(5), b.end_left());
+  EXPECT_EQ(b.end_left().flip(), b.end_right());
+  EXPECT_EQ(b.at_left_or_default(7), "");
+  EXPECT_EQ(b.at_right_or_default("seven"), 0);
+  EXPECT_EQ(b.size(), 4);
+
+  EXPECT_TRUE(b.erase_left(1));
+  EXPECT_FALSE(b.erase_right("one"));
+  b.erase_right(b.find_right("seven"));
+  EXPECT_EQ(b.size(), 2);
+  EXPECT_EQ(b.at_right("two"), 2);
+  EXPECT_EQ(b.at_right(""), 7);
+
+  unordered_bimap<int, std::string> other;
+  other.reserve(100);
+  other.insert(7, "");
+  other.insert(2, "two");
+  EXPECT_EQ(other, b);
+  other.insert(3, "three");
+  EXPECT_NE(other, b);
+}
+
+TEST(unordered_bimap, hashes_once) {
+  struct counting_hash {
+    size_t operator()(int key) const {
+      ++*calls;
+      return std::hash<int>()(key);
+    }
+
+    size_t* calls;
+  };
+
+  size_t calls = 0;
+  unordered_bimap<int, int, counting_hash, counting_hash> b(
+      counting_hash{&calls}, counting_hash{&calls});
+  b.reserve(100);
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, -i);
+  }
+  EXPECT_EQ(calls, 200);
+
+  calls = 0;
+  EXPECT_EQ(b.insert(5, 1000), b.end_left());
+  EXPECT_EQ(calls, 1);
+  EXPECT_EQ(b.insert(1000, -5), b.end_left());
+  EXPECT_EQ(calls, 3);
+}
+
+TEST(unordered_bimap, equal_by_predicate) {
+  // no operator==, equality is case-insensitive and given by the predicate
+  struct name {
+    std::string value;
+  };
+  struct lower_hash {
+    size_t operator()(const name& n) const {
+      std::string lower;
+      for (char c : n.value) {
+        lower += char(std::tolower(static_cast<unsigned char>(c)));
+      }
+      return std::hash<std::string>()(lower);
+    }
+  };
+  struct lower_equal {
+    bool operator()(const name& a, const name& b) const {
+      return std::equal(a.value.begin(), a.value.end(), b.value.begin(),
+                        b.value.end(), [](char x, char y) {
+                          return std::tolower(static_cast<unsigned char>(x)) ==
+                                 std::tolower(static_cast<unsigned char>(y));
+                        });
+    }
+  };
+
+  using names = unordered_bimap<int, name, std::hash<int>, lower_hash,
+                                std::equal_to<int>, lower_equal>;
+  names a;
+  a.insert(1, name{"One"});
+  a.insert(2, name{"two"});
+  names b;
+  b.insert(2, name{"TWO"});
+  b.insert(1, name{"one"});
+  EXPECT_TRUE(a == b);
+  EXPECT_EQ(b.find_right(name{"tWo"}).flip(), b.find_left(2));
+
+  b.erase_left(1);
+  b.insert(1, name{"uno"});
+  EXPECT_TRUE(a != b);
+}
+
+TEST(concurrent_bimap, simple) {
+  concurrent_bimap<int, std::string> b;
+  EXPECT_TRUE(b.insert(1, "one"));
+  EXPECT_TRUE(b.insert(2, "two"));
+  EXPECT_FALSE(b.insert(3, "one"));
+  EXPECT_FALSE(b.insert(1, "uno"));
+  EXPECT_EQ(b.size(), 2);
+
+  EXPECT_EQ(b.at_left(2), "two");
+  EXPECT_EQ(b.at_right("one"), 1);
+  EXPECT_THROW(b.at_left(3), std::out_of_range);
+  EXPECT_EQ(b.find_left(3), std::nullopt);
+  EXPECT_TRUE(b.contains_right("two"));
+
+  EXPECT_TRUE(b.erase_right("one"));
+  EXPECT_FALSE(b.erase_left(1));
+  EXPECT_TRUE(b.insert(1, "uno"));
+  EXPECT_EQ(b.at_right("uno"), 1);
+  EXPECT_TRUE(b.erase_left(2));
+  EXPECT_FALSE(b.contains_right("two"));
+  EXPECT_EQ(b.size(), 1);
+}
+
+TEST(persistent_bimap, simple) {
+  persistent_bimap<int, std::string> b;
+  EXPECT_EQ(*b.insert(2, "two"), 2);
+  EXPECT_EQ(*b.insert(1, "one"), 1);
+  auto it = b.insert(3, "one");
+  EXPECT_EQ(it, b.end_left());
+  EXPECT_EQ(b.size(), 2);
+
+  persistent_bimap<int, std::string> snapshot = b;
+  b.insert(3, "three");
+  EXPECT_TRUE(b.erase_right("one"));
+  EXPECT_EQ(b.at_left_or_default(4), "");
+
+  EXPECT_EQ(snapshot.size(), 2);
+  EXPECT_EQ(snapshot.at_left(1), "one");
+  EXPECT_EQ(snapshot.find_left(3), snapshot.end_left());
+  EXPECT_EQ(*snapshot.begin_right().flip(), 1);
+  EXPECT_EQ(snapshot.end_left().flip(), snapshot.end_right());
+
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(b.at_right("three"), 3);
+  EXPECT_EQ(b.begin_left()[2], 4);
+  EXPECT_EQ(b.end_right() - b.begin_right(), 3);
+  EXPECT_EQ(*b.upper_bound_left(2), 3);
+  EXPECT_EQ(*b.lower_bound_right("t"), "three");
+  EXPECT_EQ(*b.erase_left(b.find_left(3)), 4);
+  EXPECT_THROW(b.at_left(3), std::out_of_range);
+
+  EXPECT_NE(b, snapshot);
+  b = snapshot;
+  EXPECT_EQ(b, snapshot);
+}
+
+TEST(persistent_bimap, iterate_large) {
+  persistent_bimap<int, int> b;
+  const int n = 100000;
+  for (int i = 0; i < n; i++) {
+    b.insert(i * 7 % n, -i);
+  }
+  persistent_bimap<int, int> snapshot = b;
+  b.erase_left(n / 2);
+
+  int expected = 0;
+  for (auto it = snapshot.begin_left(); it != snapshot.end_left(); ++it) {
+    ASSERT_EQ(*it, expected);
+    ASSERT_EQ(it - snapshot.begin_left(), expected);
+    expected++;
+  }
+  EXPECT_EQ(expected, n);
+
+  for (auto it = snapshot.end_right(); it != snapshot.begin_right();) {
+    --it;
+    expected--;
+    ASSERT_EQ(*it, -(n - 1) + expected);
+  }
+  EXPECT_EQ(expected, 0);
+
+  auto it = snapshot.find_left(n / 2);
+  it--;
+  it += 2;
+  EXPECT_EQ(*it++, n / 2 + 1);
+  EXPECT_EQ(*--it.flip().flip(), n / 2 + 1);
+  EXPECT_EQ(*--snapshot.end_left(), n - 1);
+  EXPECT_EQ(*++b.find_left(n / 2 - 1), n / 2 + 1);
+}
+
+TEST(concurrent_bimap, slow_reader) {
+  // a lookup of -1 stops inside the tree until the gate opens
+  struct gated_less {
+    bool operator()(int a, int b) const {
+      if (a == -1 || b == -1) {
+        entered->store(true);
+        while (!open->load()) {
+          std::this_thread::yield();
+        }
+      }
+      return a < b;
+    }
+
+    std::atomic<bool>* entered;
+    std::atomic<bool>* open;
+  };
+
+  std::atomic<bool> entered{false};
+  std::atomic<bool> open{false};
+  using map_t = concurrent_bimap<int, int, gated_less>;
+  map_t b(gated_less{&entered, &open});
+  b.insert(0, 0);
+
+  std::thread reader([&] { EXPECT_FALSE(b.contains_left(-1)); });
+  while (!entered.load()) {
+    std::this_thread::yield();
+  }
+
+  // writes retire the versions the reader may hold instead of waiting
+  for (int i = 1; i <= static_cast<int>(map_t::retired_limit); i++) {
+    EXPECT_TRUE(b.insert(i, i));
+  }
+  EXPECT_EQ(b.size(), map_t::retired_limit + 1);
+
+  open.store(true);
+  reader.join();
+  for (int i = 1; i <= static_cast<int>(map_t::retired_limit); i++) {
+    EXPECT_TRUE(b.erase_left(i));
+  }
+  EXPECT_EQ(b.at_left(0), 0);
+}
+
+TEST(concurrent_bimap, snapshot) {
+  concurrent_bimap<int, int> b;
+  b.insert(1, 10);
+  b.insert(2, 20);
+
+  auto snapshot = b.snapshot();
+  b.erase_left(1);
+  b.insert(3, 30);
+
+  EXPECT_EQ(snapshot.size(), 2);
+  EXPECT_EQ(snapshot.at_right(10), 1);
+  EXPECT_EQ(snapshot.find_left(3), snapshot.end_left());
+  EXPECT_EQ(b.snapshot().at_left(3), 30);
+}
+
+TEST(bimap, copy_throws) {
+  struct counted_copy {
+    counted_copy(int value, int* budget) : value(value), budget(budget) {}
+
+    counted_copy(const counted_copy& other)
+        : value(other.value), budget(other.budget) {
+      if ((*budget)-- == 0) {
+        throw std::runtime_error("copy");
+      }
+    }
+
+    bool operator<(const counted_copy& other) const {
+      return value < other.value;
+    }
+
+    int value;
+    int* budget;
+  };
+
+  using counted_bimap = bimap<counted_copy, int>;
+
+  int budget = 1 << 30;
+  counted_bimap b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(counted_copy((i * 7919) % 1000, &budget), i);
+  }
+
+  budget = 500;
+  EXPECT_THROW(counted_bimap{b}, std::runtime_error);
+  size_t forward = 0;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it, ++forward) {
+    EXPECT_EQ(it->value, static_cast<int>(forward));
+  }
+  size_t backward = 0;
+  for (auto it = b.end_left(); it != b.begin_left(); --it) {
+    ++backward;
+  }
+  EXPECT_EQ(forward, 1000);
+  EXPECT_EQ(backward, 1000);
+}
+
+TEST(bimap, concurrent_copies) {
+  bimap<int, int> b;
+  for (int i = 0; i < 10000; i++) {
+    b.insert(i, (i * 7919) % 10000);
+  }
+
+  const auto& source = b;
+  std::vector<std::thread> threads;
+  std::vector<char> equal(4, false);
+  for (size_t t = 0; t < equal.size(); t++) {
+    threads.emplace_back([&, t] {
+      bimap<int, int> copy = source;
+      equal[t] = copy == source && copy.at_right(7919) == 1;
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(equal, std::vector<char>(equal.size(), true));
+}
+
+TEST(multi_index, simple) {
+  struct by_id;
+  struct by_name;
+  struct by_phone;
+  using employees =
+      multi_index<double,
+                  indexed_by<ordered_unique<by_id, int>,
+                             ordered_unique<by_name, std::string, std::greater<>>,
+                             ordered_unique<by_phone, std::string>>>;
+
+  employees m;
+  EXPECT_TRUE(m.empty());
+  auto it = m.insert(1.5, 3, "carol", "555-03");
+  EXPECT_EQ(*it, 1.5);
+  EXPECT_EQ(it.key<by_name>(), "carol");
+  m.insert(2.5, 1, "alice", "555-01");
+  m.insert(3.5, 2, "bob", "555-02");
+  EXPECT_EQ(m.insert(0, 4, "bob", "555-04"), m.end<by_id>());
+  EXPECT_EQ(m.insert(0, 4, "dave", "555-01"), m.end<by_id>());
+  EXPECT_EQ(m.size(), 3);
+
+  std::vector<int> ids;
+  for (auto i = m.begin<by_id>(); i != m.end<by_id>(); ++i) {
+    ids.push_back(i.key<by_id>());
+  }
+  EXPECT_EQ(ids, std::vector<int>({1, 2, 3}));
+  EXPECT_EQ(m.begin<by_name>().key<by_name>(), "carol");
+  EXPECT_EQ(*m.find<by_phone>("555-02"), 3.5);
+  EXPECT_EQ(m.find<by_name>("bob").project<by_id>().key<by_id>(), 2);
+  EXPECT_EQ(m.end<by_name>().project<by_phone>(), m.end<by_phone>());
+  EXPECT_EQ(m.lower_bound<by_phone>("555-025").key<by_id>(), 3);
+  EXPECT_EQ(m.upper_bound<by_id>(3), m.end<by_id>());
+
+  auto bob = m.find<by_id>(2);
+  EXPECT_FALSE(m.replace<by_name>(bob, "alice"));
+  EXPECT_TRUE(m.replace<by_name>(bob, "robert"));
+  EXPECT_EQ(m.find<by_name>("bob"), m.end<by_name>());
+  EXPECT_EQ(m.begin<by_name>().project<by_id>(), bob);
+  m.modify(bob, [](double& salary) { salary *= 2; });
+  EXPECT_EQ(*m.find<by_phone>("555-02"), 7);
+
+  employees copy = m;
+  EXPECT_TRUE(m.erase<by_name>("robert"));
+  EXPECT_FALSE(m.erase<by_name>("robert"));
+  EXPECT_EQ(m.find<by_id>(2), m.end<by_id>());
+  EXPECT_EQ(*m.erase(m.begin<by_phone>()), 1.5);
+  EXPECT_EQ(m.size(), 1);
+  EXPECT_EQ(copy.size(), 3);
+  EXPECT_EQ(copy.find<by_phone>("555-02").key<by_name>(), "robert");
+
+  m = std::move(copy);
+  EXPECT_EQ(m.size(), 3);
+  m.clear();
+  EXPECT_TRUE(m.empty());
+}
+
 template <typename T>
 std::vector<std::pair<T, T>>
 eliminate_same(std::vector<T> &lefts, std::vector<T> &rights, std::mt19937 &e) {
@@ -360,9 +1640,42 @@ eliminate_same(std::vector<T> &lefts, std::vector<T> &rights, std::mt19937 &e) {
 
 template struct bimap<int, non_default_constructible>;
 template struct bimap<non_default_constructible, int>;
+template class flat_bimap<int, non_default_constructible>;
+template class flat_bimap<non_default_constructible, int>;
+template class unordered_bimap<int, int>;
+template class multi_index<int, indexed_by<ordered_unique<struct tag_a, int>,
+                                           ordered_unique<struct tag_b, int>>>;
 
 static constexpr uint32_t seed = 1488228;
 
+TEST(multi_index, concurrent_copies) {
+  struct by_a;
+  struct by_b;
+  using pairs = multi_index<int, indexed_by<ordered_unique<by_a, int>,
+                                            ordered_unique<by_b, int>>>;
+  pairs m;
+  for (int i = 0; i < 10000; i++) {
+    m.insert(i, i, (i * 7919) % 10000);
+  }
+
+  const auto& source = m;
+  std::vector<std::thread> threads;
+  std::vector<size_t> matches(4, 0);
+  for (size_t t = 0; t < matches.size(); t++) {
+    threads.emplace_back([&, t] {
+      pairs copy = source;
+      auto it = copy.begin<by_b>();
+      for (auto s = source.begin<by_b>(); s != source.end<by_b>(); ++s, ++it) {
+        matches[t] += *it == *s && it.key<by_a>() == s.key<by_a>();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(matches, std::vector<size_t>(matches.size(), m.size()));
+}
+
 TEST(bimap_randomized, comparison) {
   std::cout << "Seed used for randomized compare test is " << seed << std::endl;
 
@@ -392,6 +1705,520 @@ TEST(bimap_randomized, comparison) {
   EXPECT_EQ(b1, b2);
 }
 
+TEST(bimap_randomized, from_sorted) {
+  std::mt19937 e(seed);
+  std::vector<std::pair<uint32_t, uint32_t>> data(50000);
+  for (auto &p : data) {
+    p = {e() % 40000, e() % 40000};
+  }
+
+  bimap<uint32_t, uint32_t> expected;
+  std::stable_sort(data.begin(), data.end(),
+                   [](auto const &a, auto const &b) { return a.first < b.first; });
+  for (auto const &p : data) {
+    expected.insert(p.first, p.second);
+  }
+
+  auto b = bimap<uint32_t, uint32_t>::from_sorted(data.begin(), data.end());
+  EXPECT_EQ(b.size(), expected.size());
+  EXPECT_EQ(b, expected);
+
+  for (size_t i = 0; i < 1000; i++) {
+    b.erase_left(b.lower_bound_left(e() % 40000));
+    b.insert(e() % 40000, e() % 40000);
+  }
+  uint32_t previous = *b.begin_right();
+  for (auto it = ++b.begin_right(); it != b.end_right(); it++) {
+    EXPECT_GT(*it, previous);
+    previous = *it;
+  }
+}
+
+TEST(bimap_randomized, set_operations) {
+  std::mt19937 e(seed);
+  bimap<int, int> a, b;
+  for (size_t i = 0; i < 20000; i++) {
+    a.insert(e() % 30000, e() % 30000);
+    b.insert(e() % 30000, e() % 30000);
+  }
+
+  bimap<int, int> merged = a, source = b;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    if (a.find_left(*it) == a.end_left() &&
+        a.find_right(*it.flip()) == a.end_right()) {
+      source.erase_left(*it);
+    }
+  }
+  bimap<int, int> expected_merged = a;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    expected_merged.insert(*it, *it.flip());
+  }
+  bimap<int, int> rest = b;
+  merged.merge(rest);
+  EXPECT_EQ(merged, expected_merged);
+  EXPECT_EQ(rest, source);
+
+  bimap<int, int> both = merged, expected_both;
+  both.intersect(a);
+  EXPECT_EQ(both, a);
+
+  for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+    if (e() % 2 == 0) {
+      expected_both.insert(*it, *it.flip());
+    }
+  }
+  bimap<int, int> difference = a;
+  difference.subtract(expected_both);
+  for (auto it = expected_both.begin_left(); it != expected_both.end_left();
+       ++it) {
+    EXPECT_EQ(difference.find_left(*it), difference.end_left());
+  }
+  EXPECT_EQ(difference.size() + expected_both.size(), a.size());
+}
+
+TEST(bimap_randomized, parallel_bulk) {
+  std::mt19937 e(seed);
+  bimap_impl::thread_executor executor(4);
+
+  std::vector<std::pair<int, int>> initial(30000), bulk(60000);
+  for (auto &p : initial) {
+    p = {e() % 100000, e() % 100000};
+  }
+  for (auto &p : bulk) {
+    p = {e() % 100000, e() % 100000};
+  }
+
+  bimap<int, int> expected, b;
+  for (auto const &p : initial) {
+    expected.insert(p.first, p.second);
+    b.insert(p.first, p.second);
+  }
+  for (auto const &p : bulk) {
+    expected.insert(p.first, p.second);
+  }
+
+  b.insert_bulk(bulk.begin(), bulk.end(), executor);
+  EXPECT_EQ(b, expected);
+  EXPECT_EQ(b.end_right() - b.begin_right(), expected.size());
+
+  bimap<int, int> other;
+  other.insert_bulk(initial.begin(), initial.end());
+  bimap<int, int> difference = b, common = b;
+  difference.subtract(other, executor);
+  common.intersect(other, executor);
+  EXPECT_EQ(common, other);
+  EXPECT_EQ(difference.size() + common.size(), b.size());
+
+  difference.merge(std::move(common), executor);
+  EXPECT_EQ(difference, b);
+}
+
+TEST(bimap_randomized, flat_compare_to_bimap) {
+  flat_bimap<int, int> f;
+  bimap<int, int> b;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 20000; i++) {
+    unsigned int op = e() % 10;
+    if (op > 3) {
+      int l = e() % 10000, r = e() % 10000;
+      auto it = f.insert(l, r);
+      EXPECT_EQ(it == f.end_left(), b.insert(l, r) == b.end_left());
+    } else if (op > 0) {
+      int key = e() % 10000;
+      EXPECT_EQ(f.erase_right(key), b.erase_right(key));
+    } else {
+      int lo = e() % 10000, hi = lo + e() % 100;
+      f.erase_left(f.lower_bound_left(lo), f.lower_bound_left(hi));
+      b.erase_left(b.lower_bound_left(lo), b.lower_bound_left(hi));
+    }
+
+    if (i % 500 == 0) {
+      ASSERT_EQ(f.size(), b.size());
+      auto fit = f.begin_right();
+      for (auto it = b.begin_right(); it != b.end_right(); ++it, ++fit) {
+        EXPECT_EQ(*fit, *it);
+        EXPECT_EQ(*fit.flip(), *it.flip());
+        EXPECT_EQ(fit.flip().flip(), fit);
+      }
+      for (int key = 0; key < 10000; key += 37) {
+        EXPECT_EQ(f.lower_bound_left(key) - f.begin_left(),
+                  b.lower_bound_left(key) - b.begin_left());
+        EXPECT_EQ(f.upper_bound_right(key) - f.begin_right(),
+                  b.upper_bound_right(key) - b.begin_right());
+      }
+    }
+  }
+}
+
+TEST(bimap_randomized, unordered_compare_to_bimap) {
+  unordered_bimap<int, int> u;
+  bimap<int, int> b;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 100000; i++) {
+    int l = e() % 5000, r = e() % 5000;
+    if (e() % 3 != 0) {
+      auto it = u.insert(l, r);
+      EXPECT_EQ(it == u.end_left(), b.insert(l, r) == b.end_left());
+    } else {
+      EXPECT_EQ(u.erase_left(l), b.erase_left(l));
+    }
+
+    if (i % 1000 == 0) {
+      ASSERT_EQ(u.size(), b.size());
+      for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+        EXPECT_EQ(u.at_left(*it), *it.flip());
+        EXPECT_EQ(u.at_right(*it.flip()), *it);
+      }
+    }
+  }
+
+  for (auto it = u.begin_left(); it != u.end_left();) {
+    it = u.erase_left(it);
+  }
+  EXPECT_TRUE(u.empty());
+  EXPECT_EQ(u.find_left(0), u.end_left());
+}
+
+TEST(bimap_randomized, concurrent_readers) {
+  concurrent_bimap<int, int> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, -i);
+  }
+
+  std::atomic<bool> done{false};
+  std::atomic<size_t> mismatches{0};
+  std::vector<std::thread> readers;
+  for (size_t t = 0; t < 4; t++) {
+    readers.emplace_back([&, t] {
+      std::mt19937 e(seed + t);
+      while (!done.load()) {
+        int key = e() % 2000;
+        auto right = b.find_left(key);
+        if (key < 1000 ? right != -key : right && *right != -key) {
+          mismatches++;
+        }
+      }
+    });
+  }
+
+  // pairs below 1000 are never removed, the others come and go
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 5000; i++) {
+    int key = 1000 + e() % 1000;
+    if (e() % 2) {
+      b.insert(key, -key);
+    } else {
+      b.erase_right(-key);
+    }
+  }
+
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(mismatches.load(), 0);
+  EXPECT_GE(b.size(), 1000);
+}
+
+TEST(bimap_randomized, persistent_snapshots) {
+  persistent_bimap<int, int> b;
+  std::vector<persistent_bimap<int, int>> snapshots;
+  std::vector<std::vector<std::pair<int, int>>> expected;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 20000; i++) {
+    int l = e() % 3000, r = e() % 3000;
+    if (e() % 3 != 0) {
+      b.insert(l, r);
+    } else {
+      b.erase_left(l);
+    }
+
+    if (i % 2000 == 0) {
+      snapshots.push_back(b);
+      expected.emplace_back();
+      for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+        expected.back().emplace_back(*it, *it.flip());
+      }
+    }
+  }
+
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    ASSERT_EQ(snapshots[i].size(), expected[i].size());
+    for (auto const &p : expected[i]) {
+      EXPECT_EQ(snapshots[i].at_left(p.first), p.second);
+      EXPECT_EQ(snapshots[i].at_right(p.second), p.first);
+    }
+  }
+}
+
+TEST(bimap_randomized, copy) {
+  bimap<uint32_t, uint32_t> b;
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 30000; i++) {
+    b.insert(e() % 20000, e() % 20000);
+  }
+  for (size_t i = 0; i < 5000; i++) {
+    b.erase_right(e() % 20000);
+  }
+
+  bimap<uint32_t, uint32_t> copy = b;
+  EXPECT_EQ(copy, b);
+  for (auto it = b.begin_right(); it != b.end_right(); ++it) {
+    EXPECT_EQ(copy.at_right(*it), *it.flip());
+  }
+
+  copy.erase_left(copy.begin_left());
+  EXPECT_NE(copy, b);
+  copy.insert(*b.begin_left(), *b.begin_left().flip());
+  EXPECT_EQ(copy, b);
+}
+
+TEST(bimap_randomized, copy_structure) {
+  bimap<uint32_t, uint32_t> b;
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 200000; i++) {
+    b.insert(e(), e());
+  }
+
+  bimap<uint32_t, uint32_t> copy = b;
+  ASSERT_EQ(copy.size(), b.size());
+  auto left = b.begin_left();
+  auto copy_left = copy.begin_left();
+  for (; left != b.end_left(); ++left, ++copy_left) {
+    EXPECT_EQ(*copy_left, *left);
+    EXPECT_EQ(*copy_left.flip(), *left.flip());
+  }
+  EXPECT_EQ(copy_left, copy.end_left());
+
+  auto right = b.end_right();
+  auto copy_right = copy.end_right();
+  while (right != b.begin_right()) {
+    --right;
+    --copy_right;
+    EXPECT_EQ(*copy_right, *right);
+    EXPECT_EQ(*copy_right.flip(), *right.flip());
+  }
+  EXPECT_EQ(copy_right, copy.begin_right());
+
+  for (size_t i = 0; i < 1000; i++) {
+    size_t k = e() % b.size();
+    EXPECT_EQ(*copy.nth_left(k), *b.nth_left(k));
+    EXPECT_EQ(*copy.nth_right(k), *b.nth_right(k));
+    EXPECT_EQ(copy.find_right(*b.nth_right(k)) - copy.begin_right(),
+              static_cast<ptrdiff_t>(k));
+  }
+
+#ifdef BIMAP_STATS
+  EXPECT_EQ(copy.stats().left.depth_histogram, b.stats().left.depth_histogram);
+  EXPECT_EQ(copy.stats().right.depth_histogram,
+            b.stats().right.depth_histogram);
+#endif
+}
+
+TEST(bimap_randomized, insert_hint) {
+  bimap<uint32_t, uint32_t> expected;
+  bimap<uint32_t, uint32_t> b;
+  std::mt19937 e(seed);
+  auto hint = b.end_left();
+  for (size_t i = 0; i < 30000; i++) {
+    uint32_t left = i % 3 == 0 ? e() % 20000 : i / 2;
+    uint32_t right = e() % 20000;
+    if (i % 5 == 0 && !b.empty()) {
+      hint = b.nth_left(e() % b.size());
+    }
+
+    bool inserted = expected.insert(left, right) != expected.end_left();
+    auto it = b.insert(hint, left, right);
+    EXPECT_EQ(it != b.end_left(), inserted);
+    if (inserted) {
+      hint = it;
+    }
+  }
+
+  EXPECT_EQ(b, expected);
+}
+
+TEST(bimap_randomized, replace) {
+  bimap<uint32_t, uint32_t> b;
+  std::map<uint32_t, uint32_t> lefts;
+  std::map<uint32_t, uint32_t> rights;
+  std::mt19937 e(seed);
+  for (uint32_t i = 0; i < 1000; i++) {
+    b.insert(i * 2, i * 2);
+    lefts[i * 2] = i * 2;
+    rights[i * 2] = i * 2;
+  }
+
+  for (size_t i = 0; i < 20000; i++) {
+    size_t index = e() % 1000;
+    uint32_t value = e() % 2100;
+    if (i % 2 == 0) {
+      uint32_t key = std::next(lefts.begin(), index)->first;
+      bool free = rights.count(value) == 0 || rights[value] == key;
+      EXPECT_EQ(b.replace_right(b.find_left(key), value), free);
+      if (free) {
+        rights.erase(lefts[key]);
+        lefts[key] = value;
+        rights[value] = key;
+      }
+    } else {
+      uint32_t right = std::next(rights.begin(), index)->first;
+      bool free = lefts.count(value) == 0 || lefts[value] == right;
+      EXPECT_EQ(b.replace_left(b.find_right(right), value), free);
+      if (free) {
+        lefts.erase(rights[right]);
+        rights[right] = value;
+        lefts[value] = right;
+      }
+    }
+  }
+
+  EXPECT_EQ(b.size(), lefts.size());
+  auto left = b.begin_left();
+  for (auto const& [l, r] : lefts) {
+    EXPECT_EQ(*left, l);
+    EXPECT_EQ(*left.flip(), r);
+    ++left;
+  }
+  auto right = b.begin_right();
+  for (auto const& [r, l] : rights) {
+    EXPECT_EQ(*right, r);
+    EXPECT_EQ(*right.flip(), l);
+    ++right;
+  }
+}
+
+TEST(bimap_randomized, find_batch) {
+  bimap<uint32_t, uint32_t> b;
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 20000; i++) {
+    b.insert(e() % 40000, e() % 40000);
+  }
+
+  std::vector<uint32_t> keys(1000);
+  for (auto& key : keys) {
+    key = e() % 40000;
+  }
+  std::vector<bimap<uint32_t, uint32_t>::left_iterator> lefts(keys.size());
+  std::vector<bimap<uint32_t, uint32_t>::right_iterator> rights(keys.size());
+  b.find_left_batch(keys.begin(), keys.end(), lefts.begin());
+  b.find_right_batch(keys.begin(), keys.end(), rights.begin());
+  for (size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(lefts[i], b.find_left(keys[i]));
+    EXPECT_EQ(rights[i], b.find_right(keys[i]));
+  }
+}
+
+TEST(bimap_randomized, multi_index_compare_to_bimap) {
+  struct by_left;
+  struct by_right;
+  using pairs = multi_index<int, indexed_by<ordered_unique<by_left, uint32_t>,
+                                            ordered_unique<by_right, uint32_t>>,
+                            bimap_impl::slab_allocator<int>>;
+
+  bimap<uint32_t, uint32_t> expected;
+  pairs m;
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 30000; i++) {
+    uint32_t left = e() % 10000;
+    uint32_t right = e() % 10000;
+    uint32_t op = e() % 4;
+    auto found = expected.find_right(right);
+    if (op == 0) {
+      EXPECT_EQ(m.erase<by_right>(right), expected.erase_right(right));
+    } else if (op == 1 && found != expected.end_right()) {
+      bool replaced = expected.replace_left(found, left);
+      EXPECT_EQ(m.replace<by_left>(m.find<by_right>(right), left), replaced);
+    } else {
+      bool inserted = expected.insert(left, right) != expected.end_left();
+      EXPECT_EQ(m.insert(0, left, right) != m.end<by_left>(), inserted);
+    }
+  }
+
+  pairs copy = m;
+  m.clear();
+  EXPECT_EQ(copy.size(), expected.size());
+  auto it = copy.begin<by_right>();
+  for (auto r = expected.begin_right(); r != expected.end_right(); ++r, ++it) {
+    EXPECT_EQ(it.key<by_right>(), *r);
+    EXPECT_EQ(it.key<by_left>(), *r.flip());
+  }
+  auto l = copy.end<by_left>();
+  for (auto r = expected.end_left(); r != expected.begin_left();) {
+    EXPECT_EQ((--l).key<by_left>(), *--r);
+  }
+}
+
+TEST(bimap_randomized, bounds_compare_to_map) {
+  bimap<int, int> b;
+  std::map<int, int> lefts;
+  std::map<int, int> rights;
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 5000; i++) {
+    int left = e() % 10000;
+    int right = e() % 10000;
+    if (b.insert(left, right) != b.end_left()) {
+      lefts.emplace(left, right);
+      rights.emplace(right, left);
+    }
+  }
+
+  for (int key = -1; key <= 10000; key++) {
+    auto left = lefts.upper_bound(key);
+    auto right = rights.upper_bound(key);
+    auto found_left = b.upper_bound_left(key);
+    auto found_right = b.upper_bound_right(key);
+    ASSERT_EQ(found_left == b.end_left(), left == lefts.end());
+    ASSERT_EQ(found_right == b.end_right(), right == rights.end());
+    if (left != lefts.end()) {
+      EXPECT_EQ(*found_left, left->first);
+    }
+    if (right != rights.end()) {
+      EXPECT_EQ(*found_right, right->first);
+    }
+    EXPECT_EQ(b.lower_bound_left(key) - b.begin_left(),
+              std::distance(lefts.begin(), lefts.lower_bound(key)));
+  }
+}
+
+TEST(bimap_randomized, unsized_compare_to_bimap) {
+  using unsized = bimap<int, int, std::less<int>, std::less<int>,
+                        std::allocator<std::pair<int, int>>,
+                        bimap_impl::no_subtree_sizes>;
+  unsized u;
+  bimap<int, int> b;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 30000; i++) {
+    int l = e() % 3000, r = e() % 3000;
+    unsigned int op = e() % 8;
+    if (op > 2) {
+      EXPECT_EQ(u.insert(l, r) == u.end_left(),
+                b.insert(l, r) == b.end_left());
+    } else if (op > 0) {
+      EXPECT_EQ(u.erase_right(r), b.erase_right(r));
+    } else {
+      auto it = u.find_left(l);
+      auto expected = b.find_left(l);
+      ASSERT_EQ(it == u.end_left(), expected == b.end_left());
+      if (it != u.end_left()) {
+        EXPECT_EQ(u.replace_right(it, r), b.replace_right(expected, r));
+      }
+    }
+    ASSERT_EQ(u.size(), b.size());
+  }
+
+  auto ut = u.begin_left();
+  for (auto it = b.begin_left(); it != b.end_left(); ++it, ++ut) {
+    EXPECT_EQ(*ut, *it);
+    EXPECT_EQ(*ut.flip(), *it.flip());
+  }
+  EXPECT_EQ(ut, u.end_left());
+}
+
 TEST(bimap_randomized, invariant_check) {
   std::cout << "Seed used for randomized invariant test is " << seed
             << std::endl;
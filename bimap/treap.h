@@ -1,40 +1,156 @@
+#include "executor.h"
 #include "node_base.h"
-#include <random>
+#include "stats.h"
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace bimap_impl {
-template <typename Key, typename Tag>
-struct node : node_base {
-  explicit node(Key key, size_t rank) : key(std::move(key)), rank(rank) {}
+// Cheap source of treap priorities: xorshift64* with eight bytes of state.
+// Equal seeds give equal sequences, so treap shapes are reproducible.
+class priority_source {
+public:
+  explicit priority_source(uint64_t seed) noexcept : state(mix(seed)) {}
+
+  // Seeds from the address of the owner, so that different owners get
+  // different sequences without asking the system for entropy.
+  explicit priority_source(const void* owner) noexcept
+      : priority_source(reinterpret_cast<uintptr_t>(owner)) {}
+
+  void seed(uint64_t seed) noexcept {
+    state = mix(seed);
+  }
+
+  uint32_t operator()() noexcept {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return static_cast<uint32_t>((state * 0x2545F4914F6CDD1DULL) >> 32);
+  }
+
+private:
+  // splitmix64 finalizer, never yields the all-zero state from a small seed
+  static uint64_t mix(uint64_t value) noexcept {
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    value ^= value >> 31;
+    return value ? value : 0x9E3779B97F4A7C15ULL;
+  }
+
+  uint64_t state;
+};
+
+template <typename Key, typename Tag,
+          typename SizePolicy = subtree_sizes<size_t>>
+struct node : basic_node_base<SizePolicy> {
+  using base_t = basic_node_base<SizePolicy>;
+
+  explicit node(Key key) : key(std::move(key)) {}
+
+  // Constructs the key in place from a tuple of arguments.
+  template <typename Tuple>
+  node(std::piecewise_construct_t, Tuple&& args)
+      : key(std::make_from_tuple<Key>(std::forward<Tuple>(args))) {}
 
   node* get_left_node() noexcept {
-    return static_cast<node*>(node_base::get_left());
+    return static_cast<node*>(base_t::get_left());
   }
 
   const node* get_left_node() const noexcept {
-    return static_cast<const node*>(node_base::get_left());
+    return static_cast<const node*>(base_t::get_left());
   }
 
   node* get_right_node() noexcept {
-    return static_cast<node*>(node_base::get_right());
+    return static_cast<node*>(base_t::get_right());
   }
 
   const node* get_right_node() const noexcept {
-    return static_cast<const node*>(node_base::get_right());
+    return static_cast<const node*>(base_t::get_right());
+  }
+
+  // Not const so that a node extracted from its treap can get a new key
+  // before being inserted again; must not change while the node is linked.
+  Key key;
+};
+
+// Copies of the nodes of a container whose nodes are linked into several
+// treaps, found by the address of the source node: cloning the first treap
+// fills the table, cloning the others looks the copies up in it, so the
+// source is never written and may be read by other threads meanwhile.
+// Open addressing with linear probing over a power of two of at least twice
+// as many slots as nodes keeps a lookup at O(1) expected.
+template <typename Data>
+class copy_table {
+public:
+  explicit copy_table(size_t count) {
+    size_t capacity = 1;
+    while (capacity < 2 * count) {
+      capacity *= 2;
+    }
+    slots.resize(capacity);
+  }
+
+  // Must be called at most count times, every source once.
+  void add(const Data& source, Data& copy) noexcept {
+    size_t i = slot_of(&source);
+    while (slots[i].first) {
+      i = (i + 1) & (slots.size() - 1);
+    }
+    slots[i] = {&source, &copy};
+  }
+
+  // source must have been added.
+  Data& find(const Data& source) const noexcept {
+    size_t i = slot_of(&source);
+    while (slots[i].first != &source) {
+      i = (i + 1) & (slots.size() - 1);
+    }
+    return *slots[i].second;
   }
 
-  const Key key;
-  const size_t rank;
+private:
+  size_t slot_of(const Data* source) const noexcept {
+    uint64_t hash = reinterpret_cast<uintptr_t>(source) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(hash >> 32) & (slots.size() - 1);
+  }
+
+  std::vector<std::pair<const Data*, Data*>> slots;
+};
+
+// Number of elements of a treap whose nodes keep no subtree sizes; otherwise
+// the size of the dummy node tells it.
+template <typename SizePolicy>
+struct treap_length {};
+
+template <>
+struct treap_length<no_subtree_sizes> {
+  size_t length = 0;
 };
 
-template <typename Data, typename Key, typename CompareKey, typename Tag>
-class treap : node_base, CompareKey {
+template <typename Data, typename Key, typename CompareKey, typename Tag,
+          typename SizePolicy = subtree_sizes<size_t>>
+class treap : basic_node_base<SizePolicy>,
+              treap_length<SizePolicy>,
+              CompareKey {
 public:
-  using node_t = node<Key, Tag>;
+  using node_base = basic_node_base<SizePolicy>;
+  using node_t = node<Key, Tag, SizePolicy>;
+
+  static constexpr bool sized = has_subtree_sizes<SizePolicy>;
 
   static_assert(std::is_base_of_v<node_t, Data>);
 
+  // Random access is backed by subtree sizes, so arithmetic and ordering
+  // comparisons cost O(log n) rather than O(1). Without sizes the iterator
+  // is only bidirectional.
   struct const_iterator {
-    using iterator_category = std::bidirectional_iterator_tag;
+    using iterator_category =
+        std::conditional_t<sized, std::random_access_iterator_tag,
+                           std::bidirectional_iterator_tag>;
     using value_type = Data;
     using difference_type = std::ptrdiff_t;
     using pointer = value_type*;
@@ -73,6 +189,30 @@ public:
       return copy;
     }
 
+    const_iterator& operator+=(difference_type n) noexcept {
+      cur = cur->top()->nth(cur->index() + n);
+      return *this;
+    }
+
+    const_iterator& operator-=(difference_type n) noexcept {
+      return *this += -n;
+    }
+
+    const_iterator operator+(difference_type n) const noexcept {
+      auto copy = *this;
+      return copy += n;
+    }
+
+    const_iterator operator-(difference_type n) const noexcept {
+      auto copy = *this;
+      return copy -= n;
+    }
+
+    difference_type operator-(const const_iterator& other) const noexcept {
+      return static_cast<difference_type>(cur->index()) -
+             static_cast<difference_type>(other.cur->index());
+    }
+
     bool operator==(const const_iterator& other) const noexcept {
       return cur == other.cur;
     }
@@ -81,6 +221,22 @@ public:
       return cur != other.cur;
     }
 
+    bool operator<(const const_iterator& other) const noexcept {
+      return cur->index() < other.cur->index();
+    }
+
+    bool operator>(const const_iterator& other) const noexcept {
+      return other < *this;
+    }
+
+    bool operator<=(const const_iterator& other) const noexcept {
+      return !(other < *this);
+    }
+
+    bool operator>=(const const_iterator& other) const noexcept {
+      return !(*this < other);
+    }
+
     const node_base* cur = nullptr;
   };
 
@@ -106,40 +262,357 @@ public:
     auto* lhs_root = lhs.root();
     auto* rhs_root = rhs.root();
 
-    unset(lhs_root);
-    unset(rhs_root);
+    node_base::unset(lhs_root);
+    node_base::unset(rhs_root);
 
     lhs.dummy()->set_left(rhs_root);
     rhs.dummy()->set_left(lhs_root);
+    if constexpr (!sized) {
+      std::swap(lhs.length, rhs.length);
+    }
 
     std::swap(static_cast<CompareKey&>(lhs), static_cast<CompareKey&>(rhs));
   }
 
+  // represents place where node was found
+  struct found {
+    const node_base* parent;
+    const node_t* child;
+    bool is_left; // we need it, because child can be nullptr.
+  };
+
+  // Key of data must not be present in the treap.
   void insert(Data& data) noexcept {
+    insert_at(find_(static_cast<const node_t&>(data).key), data);
+  }
+
+  // Looks key up in a single descent: child is the node holding key, or
+  // nullptr and then the position is where a node with key belongs.
+  template <typename K>
+  found locate(const K& key) const noexcept {
+    return find_(key);
+  }
+
+  // Same as locate, but searches from the node of hint up and then down,
+  // which is cheap when key is close to it in order; end() searches from the
+  // root.
+  template <typename K>
+  found locate(const_iterator hint, const K& key) const noexcept {
+    return find_near_(hint.cur, key);
+  }
+
+  // Lookups of many keys at once. The descents of up to batch_width keys
+  // are interleaved (asynchronous memory access chaining): each step of a
+  // descent prefetches the next node and moves on to another key, so the
+  // cache misses of different keys overlap instead of following one
+  // another. A lane whose key is done takes the next one.
+  // f(i, it) gets the result for the i-th key; the order of calls is not
+  // the order of keys. Returns the number of keys.
+  static constexpr size_t batch_width = 16;
+
+  template <typename ForwardIt, typename F>
+  size_t find_batch(ForwardIt first, ForwardIt last, F&& f) const {
+    struct lane {
+      decltype(std::addressof(*first)) key;
+      const node_t* cur;
+      size_t index;
+    };
+
+    const node_t* top = root();
+    if (top) {
+      __builtin_prefetch(top);
+    }
+
+    lane lanes[batch_width];
+    size_t active = 0;
+    size_t index = 0;
+    for (; active < batch_width && first != last; ++active, ++first) {
+      lanes[active] = {std::addressof(*first), top, index++};
+      count(&treap_counters::searches);
+    }
+
+    while (active != 0) {
+      for (size_t i = 0; i < active;) {
+        auto& cur = lanes[i];
+        const node_base* result = dummy();
+        if (cur.cur) {
+          count(&treap_counters::search_steps);
+          if (cmp(*cur.key, cur.cur->key)) {
+            cur.cur = cur.cur->get_left_node();
+          } else if (cmp(cur.cur->key, *cur.key)) {
+            cur.cur = cur.cur->get_right_node();
+          } else {
+            result = cur.cur;
+            cur.cur = nullptr;
+          }
+
+          if (cur.cur) {
+            __builtin_prefetch(cur.cur);
+            ++i;
+            continue;
+          }
+        }
+
+        f(cur.index, const_iterator(result));
+        if (first != last) {
+          cur = {std::addressof(*first), top, index++};
+          count(&treap_counters::searches);
+          ++first;
+          ++i;
+        } else {
+          cur = lanes[--active];
+        }
+      }
+    }
+
+    return index;
+  }
+
+  // Inserts data at a position that locate returned for its key, with no
+  // child found and no change to the treap since.
+  void insert(const found& position, Data& data) noexcept {
+    insert_at(position, data);
+  }
+
+  // Gives linked data a new key with assign(key), where position is what
+  // locate returned for the new key: either data itself or a missing child.
+  // A position in one of the two gaps around data keeps its order, so the
+  // key is assigned in place. Otherwise data is unlinked first, which leaves
+  // every other missing child where it was, and is hung at position again.
+  // If assign throws, data is left out of the treap.
+  template <typename Assign>
+  void replace_key(Data& data, const found& position, Assign&& assign) {
     auto* data_node = static_cast<node_t*>(&data);
+    bool in_place = position.child == data_node ||
+                    position.parent == data_node ||
+                    (position.is_left && position.parent == data_node->next()) ||
+                    (!position.is_left && position.parent == data_node->prev());
+
+    if (!in_place) {
+      erase(data);
+    }
+
+    try {
+      std::forward<Assign>(assign)(data_node->key);
+    } catch (...) {
+      if (in_place) {
+        erase(data);
+      }
+      throw;
+    }
+
+    if (!in_place) {
+      insert_at(position, data);
+    }
+  }
+
+  void erase(const Data& data) noexcept {
+    auto* data_node = const_cast<node_t*>(static_cast<const node_t*>(&data));
+    auto* parent = data_node->get_parent();
+
+    data_node->replace_with(
+        merge(data_node->get_left_node(), data_node->get_right_node()));
+    parent->update_path_sizes();
+    data_node->reset();
+    set_length(size() - 1);
+  }
+
+  // Empties the treap in a single post-order pass, passing every node to f
+  // once it is unlinked, so f may destroy it.
+  template <typename F>
+  void clear(F&& f) noexcept {
     auto* root_ = root();
+    node_base::unset(root_);
+    set_length(0);
+    dispose(root_, f);
+  }
 
-    unset(root_);
-    auto root_splitted = split(root_, data_node->key);
+  // Empties the treap without touching its nodes, for nodes that are freed
+  // by other means or already belong to another treap.
+  void forget() noexcept {
+    dummy()->set_left(nullptr);
+    set_length(0);
+  }
 
-    root_ = merge(root_splitted.left, data_node);
-    root_ = merge(root_, root_splitted.right);
+  // Builds the treap from nodes (pointers to Data) given in strictly
+  // increasing key order in linear time. The right spine of the tree built so
+  // far serves as the stack of the Cartesian tree construction, and nodes get
+  // their sizes as soon as they leave it. The treap must be empty.
+  template <typename InputIt>
+  void assign_sorted(InputIt first, InputIt last) noexcept {
+    node_base head;
+    node_base* spine_tail = &head;
+    size_t length = 0;
+
+    for (; first != last; ++first, ++length) {
+      auto* data_node = static_cast<node_t*>(*first);
+      node_base* cur = spine_tail;
+      node_base* popped = nullptr;
+
+      while (cur != &head && rank_of(static_cast<node_t*>(cur)) < rank_of(data_node)) {
+        cur->update_size();
+        popped = cur;
+        cur = cur->get_parent();
+      }
+
+      data_node->link_left(popped);
+      cur->link_right(data_node);
+      spine_tail = data_node;
+    }
+
+    spine_tail->update_path_sizes();
+
+    auto* root_ = head.get_right();
+    if (root_) {
+      root_->detach_parent();
+    }
     dummy()->set_left(root_);
+    set_length(length);
   }
 
-  void erase(const Key& key) noexcept {
+  // Makes this empty treap a copy of other with the same shape in one walk,
+  // comparing no keys: copy(data) returns the node that takes the place of
+  // data. other is only read. If copy throws, the nodes copied so far are
+  // passed to destroy.
+  template <typename Copy, typename Destroy>
+  void clone(const treap& other, Copy&& copy, Destroy&& destroy) {
+    const node_base* top = other.root();
+    if (!top) {
+      return;
+    }
+
+    try {
+      const node_base* from = top;
+      node_base* to = &copy_node(copy, from);
+      dummy()->link_left(to);
+
+      bool entered = true;
+      const node_base* came_from = nullptr;
+      for (;;) {
+        if (auto* child = step_down(from, entered, came_from)) {
+          node_base* child_copy = &copy_node(copy, child);
+          link(to, child == from->get_left(), child_copy);
+          from = child;
+          to = child_copy;
+          entered = true;
+          continue;
+        }
+
+        // both subtrees are copied
+        to->update_size();
+        if (from == top) {
+          break;
+        }
+
+        came_from = from;
+        from = from->get_parent();
+        to = to->get_parent();
+        entered = false;
+      }
+    } catch (...) {
+      clear(destroy);
+      throw;
+    }
+
+    dummy()->update_size();
+    set_length(other.size());
+  }
+
+  // Moves all nodes of other into this treap by recursive split and join,
+  // which takes O(m log(n / m + 1)) for treaps of sizes n and m. Nodes of
+  // other whose key is already present here are detached and passed to
+  // reject once the union is done. Both treaps must be ordered by the same
+  // comparison. Independent halves of the recursion run on executor.
+  template <typename Reject>
+  void unite(treap& other, Reject&& reject) noexcept {
+    unite(other, sequential_executor(), reject);
+  }
+
+  template <typename Executor, typename Reject>
+  void unite(treap& other, const Executor& executor, Reject&& reject) noexcept {
+    auto* lhs = root();
+    auto* rhs = other.root();
+    size_t length = size() + other.size();
+    node_base::unset(lhs);
+    node_base::unset(rhs);
+    other.set_length(0);
+
+    node_list rejected;
+    dummy()->set_left(
+        unite(lhs, rhs, executor, executor.concurrency(), rejected));
+    length -= rejected.consume(reject);
+    set_length(length);
+  }
+
+  // Removes nodes depending on the node with an equal key in other:
+  // a node with a match is kept if keep(node, match) is true, a node without
+  // one is kept if keep_unmatched is set. Removed nodes are detached and
+  // passed to remove once the filtering is done. Runs in
+  // O(m log(n / m + 1)) plus the number of removed nodes, other is only read.
+  // keep may be called concurrently when executor is parallel.
+  template <typename Keep, typename Remove>
+  void filter(const treap& other, bool keep_unmatched, Keep&& keep,
+              Remove&& remove) noexcept {
+    filter(other, keep_unmatched, sequential_executor(), keep, remove);
+  }
+
+  template <typename Executor, typename Keep, typename Remove>
+  void filter(const treap& other, bool keep_unmatched,
+              const Executor& executor, Keep&& keep, Remove&& remove) noexcept {
     auto* root_ = root();
-    unset(root_);
-    auto root_splitted = split(root_, key);
-    dummy()->set_left(merge(root_splitted.left, root_splitted.right));
+    size_t length = size();
+    node_base::unset(root_);
+
+    node_list removed;
+    dummy()->set_left(filter(root_, other.root(), keep_unmatched, keep,
+                             executor, executor.concurrency(), removed));
+    length -= removed.consume(remove);
+    set_length(length);
   }
 
-  const_iterator find(const Key& key) const noexcept {
+  // Moves the nodes of [first, last) into the empty treap out. Without
+  // subtree sizes the moved nodes are counted by a walk over them.
+  void split_off(const_iterator first, const_iterator last,
+                 treap& out) noexcept {
+    if (first == last) {
+      return;
+    }
+
+    if constexpr (!sized) {
+      size_t moved = 0;
+      for (auto it = first; it != last; ++it) {
+        ++moved;
+      }
+      out.set_length(moved);
+      set_length(size() - moved);
+    }
+
+    bool to_end = last == end();
+    auto* root_ = root();
+    node_base::unset(root_);
+
+    auto head = split(root_, key_of(first));
+    auto* extracted = merge(head.middle, head.right);
+    node_t* rest = nullptr;
+
+    if (!to_end) {
+      auto tail = split(extracted, key_of(last));
+      extracted = tail.left;
+      rest = merge(tail.middle, tail.right);
+    }
+
+    dummy()->set_left(merge(head.left, rest));
+    out.dummy()->set_left(extracted);
+  }
+
+  template <typename K>
+  const_iterator find(const K& key) const noexcept {
     auto found = find_(key);
     return found.child ? found.child : dummy();
   }
 
-  const_iterator lower_bound(const Key& key) const noexcept {
+  template <typename K>
+  const_iterator lower_bound(const K& key) const noexcept {
     auto found = find_(key);
 
     if (found.child) {
@@ -153,20 +626,45 @@ public:
     }
   }
 
-  const_iterator upper_bound(const Key& key) const noexcept {
+  template <typename K>
+  const_iterator upper_bound(const K& key) const noexcept {
     auto found = find_(key);
 
-    if (found.is_left) {
-      return found.parent;
-    }
-
     if (found.child) {
       return found.child->next();
+    }
+
+    if (found.is_left) {
+      return found.parent;
     } else {
       return found.parent->next();
     }
   }
 
+  // k-th (from zero) element in order, end() if there is no such.
+  const_iterator nth(size_t k) const noexcept {
+    return k < size() ? root()->nth(k) : dummy();
+  }
+
+  // Number of elements less than key.
+  template <typename K>
+  size_t rank(const K& key) const noexcept {
+    size_t result = 0;
+    const node_t* cur = root();
+
+    while (cur != nullptr) {
+      if (cmp(cur->key, key)) {
+        auto* left = cur->get_left_node();
+        result += (left ? left->get_size() : 0) + 1;
+        cur = cur->get_right_node();
+      } else {
+        cur = cur->get_left_node();
+      }
+    }
+
+    return result;
+  }
+
   const_iterator begin() const noexcept {
     return dummy()->min();
   }
@@ -176,19 +674,202 @@ public:
   }
 
   size_t size() const noexcept {
-    return dummy()->get_size() - 1;
+    if constexpr (sized) {
+      return dummy()->get_size() - 1;
+    } else {
+      return this->length;
+    }
+  }
+
+  CompareKey key_comp() const {
+    return static_cast<const CompareKey&>(*this);
   }
 
   bool empty() const noexcept {
     return root() == nullptr;
   }
 
+#ifdef BIMAP_STATS
+  // Counters since construction or reset_stats() and the current shape,
+  // which takes a walk over all nodes.
+  treap_stats stats() const {
+    treap_stats result;
+    result.compares = counters.compares.load();
+    result.searches = counters.searches.load();
+    result.search_steps = counters.search_steps.load();
+    result.splits = counters.splits.load();
+    result.merges = counters.merges.load();
+
+    std::vector<std::pair<const node_base*, size_t>> stack;
+    if (root()) {
+      stack.emplace_back(root(), 0);
+    }
+    while (!stack.empty()) {
+      auto [node, depth] = stack.back();
+      stack.pop_back();
+      if (result.depth_histogram.size() <= depth) {
+        result.depth_histogram.resize(depth + 1);
+      }
+      ++result.depth_histogram[depth];
+
+      if (node->get_left()) {
+        stack.emplace_back(node->get_left(), depth + 1);
+      }
+      if (node->get_right()) {
+        stack.emplace_back(node->get_right(), depth + 1);
+      }
+    }
+
+    return result;
+  }
+
+  void reset_stats() noexcept {
+    counters.compares.reset();
+    counters.searches.reset();
+    counters.search_steps.reset();
+    counters.splits.reset();
+    counters.merges.reset();
+  }
+#endif
+
   static const treap& dummy_as_treap(const node_base& dummy) noexcept {
     return static_cast<const treap&>(dummy);
   }
 
 private:
-  static node_t* merge(node_t* lhs, node_t* rhs) noexcept {
+  // Both merge and split go top-down and fix sizes in one pass bottom-up
+  // afterwards, so they take constant stack whatever the depth of the treap.
+  // Results are detached from any parent.
+  node_t* merge(node_t* lhs, node_t* rhs) noexcept {
+    count(&treap_counters::merges);
+    node_base head;
+    node_base* tail = &head;
+    bool to_left = true;
+
+    while (lhs && rhs) {
+      if (rank_of(lhs) < rank_of(rhs)) {
+        link(tail, to_left, rhs);
+        tail = rhs;
+        to_left = true;
+        rhs = rhs->get_left_node();
+      } else {
+        link(tail, to_left, lhs);
+        tail = lhs;
+        to_left = false;
+        lhs = lhs->get_right_node();
+      }
+    }
+
+    link(tail, to_left, lhs ? lhs : rhs);
+    tail->update_path_sizes();
+
+    return take_left(head);
+  }
+
+  struct splitted {
+    node_t* left;
+    node_t* middle;
+    node_t* right;
+  };
+
+  splitted split(node_t* node, const Key& key) noexcept {
+    count(&treap_counters::splits);
+    // nodes less than key are hung along the right spine of left_head,
+    // nodes greater than key along the left spine of right_head
+    node_base left_head;
+    node_base right_head;
+    node_base* left_tail = &left_head;
+    node_base* right_tail = &right_head;
+    node_t* middle = nullptr;
+
+    while (node) {
+      if (cmp(key, node->key)) {
+        right_tail->link_left(node);
+        right_tail = node;
+        node = node->get_left_node();
+      } else if (cmp(node->key, key)) {
+        left_tail->link_right(node);
+        left_tail = node;
+        node = node->get_right_node();
+      } else {
+        middle = node;
+        left_tail->link_right(node->get_left());
+        right_tail->link_left(node->get_right());
+        middle->reset();
+        break;
+      }
+    }
+
+    if (!middle) {
+      left_tail->link_right(nullptr);
+      right_tail->link_left(nullptr);
+    }
+
+    left_tail->update_path_sizes();
+    right_tail->update_path_sizes();
+
+    auto* left = static_cast<node_t*>(left_head.get_right());
+    if (left) {
+      left->detach_parent();
+    }
+
+    return {left, middle, take_left(right_head)};
+  }
+
+  node_t* join(node_t* left, node_t* middle, node_t* right) noexcept {
+    return merge(merge(left, middle), right);
+  }
+
+  // Singly linked list of detached nodes threaded through their right
+  // pointers, so that parallel branches can collect nodes without locking.
+  struct node_list {
+    node_t* head = nullptr;
+    node_t* tail = nullptr;
+
+    void push(node_t* node) noexcept {
+      node->reset();
+      if (tail) {
+        tail->link_right(node);
+      } else {
+        head = node;
+      }
+      tail = node;
+    }
+
+    void append(node_list& other) noexcept {
+      if (!other.head) {
+        return;
+      }
+
+      if (tail) {
+        tail->link_right(other.head);
+      } else {
+        head = other.head;
+      }
+      tail = other.tail;
+      other = {};
+    }
+
+    // Returns the number of nodes passed to f.
+    template <typename F>
+    size_t consume(F& f) noexcept {
+      size_t consumed = 0;
+      while (head) {
+        auto* next = head->get_right_node();
+        head->reset();
+        f(static_cast<Data&>(*head));
+        head = next;
+        ++consumed;
+      }
+      tail = nullptr;
+      return consumed;
+    }
+  };
+
+  // lhs and rhs are detached roots; nodes of rhs lose on equal keys.
+  template <typename Executor>
+  node_t* unite(node_t* lhs, node_t* rhs, const Executor& executor,
+                size_t parallelism, node_list& rejected) noexcept {
     if (!lhs) {
       return rhs;
     }
@@ -197,66 +878,256 @@ private:
       return lhs;
     }
 
-    if (lhs->rank < rhs->rank) {
+    size_t total_size = fork_size(lhs, rhs);
+    node_list right_rejected;
+
+    if (rank_of(lhs) < rank_of(rhs)) {
       auto* rhs_left = rhs->get_left_node();
-      unset(rhs_left);
-      rhs->set_left(merge(lhs, rhs_left));
-      return rhs;
+      auto* rhs_right = rhs->get_right_node();
+      auto lhs_splitted = split(lhs, rhs->key);
+
+      node_t* left;
+      node_t* right;
+      fork(
+          executor, parallelism, total_size,
+          [&](size_t p) {
+            left = unite(lhs_splitted.left, rhs_left, executor, p, rejected);
+          },
+          [&](size_t p) {
+            right = unite(lhs_splitted.right, rhs_right, executor, p,
+                          right_rejected);
+          });
+      rejected.append(right_rejected);
+
+      if (lhs_splitted.middle) {
+        rejected.push(rhs);
+        return join(left, lhs_splitted.middle, right);
+      }
+
+      rhs->reset();
+      return attach(rhs, left, right);
     } else {
+      auto* lhs_left = lhs->get_left_node();
       auto* lhs_right = lhs->get_right_node();
-      unset(lhs_right);
-      lhs->set_right(merge(lhs_right, rhs));
-      return lhs;
+      auto rhs_splitted = split(rhs, lhs->key);
+
+      node_t* left;
+      node_t* right;
+      fork(
+          executor, parallelism, total_size,
+          [&](size_t p) {
+            left = unite(lhs_left, rhs_splitted.left, executor, p, rejected);
+          },
+          [&](size_t p) {
+            right = unite(lhs_right, rhs_splitted.right, executor, p,
+                          right_rejected);
+          });
+      rejected.append(right_rejected);
+
+      if (rhs_splitted.middle) {
+        rejected.push(rhs_splitted.middle);
+      }
+
+      lhs->reset();
+      return attach(lhs, left, right);
     }
   }
 
-  struct splitted {
+  template <typename Keep, typename Executor>
+  node_t* filter(node_t* node, const node_t* other, bool keep_unmatched,
+                 Keep& keep, const Executor& executor, size_t parallelism,
+                 node_list& removed) noexcept {
+    if (!node) {
+      return nullptr;
+    }
+
+    if (!other) {
+      if (keep_unmatched) {
+        return node;
+      }
+
+      dispose(node, [&](Data& data) { removed.push(&data); });
+      return nullptr;
+    }
+
+    size_t total_size = fork_size(node, other);
+    auto splitted = split(node, other->key);
+
     node_t* left;
-    node_t* middle;
     node_t* right;
-  };
+    node_list right_removed;
+    fork(
+        executor, parallelism, total_size,
+        [&](size_t p) {
+          left = filter(splitted.left, other->get_left_node(), keep_unmatched,
+                        keep, executor, p, removed);
+        },
+        [&](size_t p) {
+          right = filter(splitted.right, other->get_right_node(),
+                         keep_unmatched, keep, executor, p, right_removed);
+        });
+    removed.append(right_removed);
+
+    auto* middle = splitted.middle;
+    if (middle && !keep(static_cast<const Data&>(*middle),
+                        static_cast<const Data&>(*other))) {
+      removed.push(middle);
+      middle = nullptr;
+    }
 
-  splitted split(node_t* node, const Key& key) noexcept {
-    if (!node) {
-      return {nullptr, nullptr, nullptr};
+    return join(left, middle, right);
+  }
+
+  // Tears the detached subtree down in post-order, every node is unlinked
+  // before it is passed to f, so f may destroy it.
+  template <typename F>
+  static void dispose(node_t* node, F&& f) noexcept {
+    while (node) {
+      if (node->get_left_node()) {
+        node = node->get_left_node();
+      } else if (node->get_right_node()) {
+        node = node->get_right_node();
+      } else {
+        auto* parent = static_cast<node_t*>(node->get_parent());
+        if (parent) {
+          node_base::unset(node);
+        }
+
+        f(static_cast<Data&>(*node));
+        node = parent;
+      }
     }
+  }
 
-    auto* n_left = node->get_left_node();
-    auto* n_right = node->get_right_node();
+  // Step of a walk over a tree that needs no stack: the child of node to go
+  // down to next, or nullptr to go back up. entered tells that the walk has
+  // just come to node from above, otherwise it has come back from came_from.
+  static const node_base* step_down(const node_base* node, bool entered,
+                                    const node_base* came_from) noexcept {
+    if (entered && node->get_left()) {
+      return node->get_left();
+    }
 
-    if (cmp(key, node->key)) {
-      unset(n_left);
+    if (entered || came_from == node->get_left()) {
+      return node->get_right();
+    }
 
-      auto n_left_splitted = split(n_left, key);
-      n_left_splitted.right = merge(n_left_splitted.right, node);
+    return nullptr;
+  }
 
-      return n_left_splitted;
-    } else if (cmp(node->key, key)) {
-      unset(n_right);
+  template <typename Copy>
+  static node_base& copy_node(Copy& copy, const node_base* node) {
+    const Data& data = *static_cast<const Data*>(static_cast<const node_t*>(node));
+    return static_cast<node_t&>(copy(data));
+  }
 
-      auto n_right_splitted = split(n_right, key);
-      n_right_splitted.left = merge(node, n_right_splitted.left);
+  // Amount of work in the step of unite or filter over two subtrees, for
+  // fork(). Without subtree sizes it is unknown, and steps are split between
+  // threads for as long as there is parallelism left.
+  static size_t fork_size(const node_t* lhs, const node_t* rhs) noexcept {
+    if constexpr (sized) {
+      return lhs->get_size() + rhs->get_size();
+    } else {
+      return parallel_grain;
+    }
+  }
+
+  void set_length([[maybe_unused]] size_t length) noexcept {
+    if constexpr (!sized) {
+      this->length = length;
+    }
+  }
+
+  static node_t* attach(node_t* node, node_t* left, node_t* right) noexcept {
+    node->link_left(left);
+    node->link_right(right);
+    node->update_size();
+    return node;
+  }
 
-      return n_right_splitted;
+  static const Key& key_of(const_iterator it) noexcept {
+    return static_cast<const node_t*>(it.cur)->key;
+  }
+
+  // The rank is shared by all halves of Data, so it is stored there once.
+  static uint32_t rank_of(const node_t* node) noexcept {
+    return static_cast<const Data*>(node)->rank;
+  }
+
+  static void link(node_base* parent, bool to_left, node_base* child) noexcept {
+    if (to_left) {
+      parent->link_left(child);
     } else {
-      unset(n_left);
-      unset(n_right);
+      parent->link_right(child);
+    }
+  }
 
-      return {n_left, node, n_right};
+  static node_t* take_left(node_base& head) noexcept {
+    auto* child = static_cast<node_t*>(head.get_left());
+    if (child) {
+      child->detach_parent();
     }
+
+    return child;
   }
 
-  // represents place where node was found
-  struct found {
-    const node_base* parent;
-    const node_t* child;
-    bool is_left; // we need it, because child can be nullptr.
-  };
+  template <typename K>
+  found find_(const K& key) const noexcept {
+    count(&treap_counters::searches);
+    return descend({dummy(), root(), true}, key);
+  }
 
-  found find_(const Key& key) const noexcept {
-    found cur = {dummy(), root(), true};
+  // Finger search: climbs from the node until its subtree is known to hold
+  // the place of key, then descends from there. The subtree of a node spans
+  // the keys between the nearest ancestors it hangs left and right of, and
+  // only the side of key needs checking, so a key d positions away from the
+  // node costs O(log d) steps.
+  template <typename K>
+  found find_near_(const node_base* from, const K& key) const noexcept {
+    if (from == dummy()) {
+      return find_(key);
+    }
+
+    count(&treap_counters::searches);
+    auto* cur = static_cast<const node_t*>(from);
+    for (;;) {
+      bool to_left = cmp(key, cur->key);
+      if (!to_left && !cmp(cur->key, key)) {
+        return at(cur);
+      }
 
+      // the nearest ancestor on the side of key bounds the subtree of cur
+      const node_base* child = cur;
+      const node_base* bound = cur->get_parent();
+      while (bound != dummy() &&
+             (to_left ? bound->get_left() : bound->get_right()) == child) {
+        child = bound;
+        bound = bound->get_parent();
+        count(&treap_counters::search_steps);
+      }
+
+      if (bound == dummy()) {
+        return descend(at(cur), key);
+      }
+
+      auto* bound_node = static_cast<const node_t*>(bound);
+      if (to_left ? cmp(bound_node->key, key) : cmp(key, bound_node->key)) {
+        return descend(at(cur), key);
+      }
+      cur = bound_node;
+    }
+  }
+
+  // Position of a linked node as found would report it.
+  found at(const node_t* node) const noexcept {
+    const node_base* parent = node->get_parent();
+    return {parent, node, parent->get_left() == node};
+  }
+
+  template <typename K>
+  found descend(found cur, const K& key) const noexcept {
     while (cur.child != nullptr) {
+      count(&treap_counters::search_steps);
       if (cmp(key, cur.child->key)) {
         cur = {cur.child, cur.child->get_left_node(), true};
       } else if (cmp(cur.child->key, key)) {
@@ -269,10 +1140,36 @@ private:
     return cur;
   }
 
-  bool cmp(const Key& lhs, const Key& rhs) const noexcept {
+  // Hangs data as a leaf at position, which must be a missing child found by
+  // find_, and lifts it up until the heap order on ranks is restored.
+  void insert_at(const found& position, Data& data) noexcept {
+    auto* data_node = static_cast<node_t*>(&data);
+    link(const_cast<node_base*>(position.parent), position.is_left, data_node);
+    data_node->update_path_sizes();
+    set_length(size() + 1);
+
+    while (data_node->get_parent() != dummy() &&
+           rank_of(static_cast<node_t*>(data_node->get_parent())) <
+               rank_of(data_node)) {
+      data_node->rotate_up();
+    }
+  }
+
+  // Lookups are templated on the key type, so that callers with a
+  // transparent comparator can search by anything comparable with Key.
+  template <typename Lhs, typename Rhs>
+  bool cmp(const Lhs& lhs, const Rhs& rhs) const noexcept {
+    count(&treap_counters::compares);
     return static_cast<const CompareKey&>(*this)(lhs, rhs);
   }
 
+  void count([[maybe_unused]] stat_counter treap_counters::*counter) const
+      noexcept {
+#ifdef BIMAP_STATS
+    (counters.*counter).add();
+#endif
+  }
+
   node_base* dummy() noexcept {
     return static_cast<node_base*>(this);
   }
@@ -289,5 +1186,9 @@ private:
     return static_cast<const node_t*>(
         static_cast<const node_base&>(*this).get_left());
   }
+
+#ifdef BIMAP_STATS
+  treap_counters counters;
+#endif
 };
 } // namespace bimap_impl
@@ -0,0 +1,655 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace bimap_impl {
+struct left_tag;
+struct right_tag;
+
+// Control bytes of an open-addressing table: a full slot holds the low seven
+// bits of its key's hash, so most mismatches are rejected without touching
+// the keys.
+constexpr int8_t ctrl_empty = -128;
+constexpr int8_t ctrl_deleted = -2;
+
+// Sixteen control bytes probed at once: one SSE2 compare yields a bit mask of
+// candidate slots. Groups are aligned in the table, so loads never wrap.
+class probe_group {
+public:
+  static constexpr size_t width = 16;
+
+  explicit probe_group(const int8_t* ctrl) noexcept : ctrl(ctrl) {}
+
+  uint32_t match(int8_t h2) const noexcept {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(load(), _mm_set1_epi8(h2)));
+#else
+    return scalar_match([h2](int8_t c) { return c == h2; });
+#endif
+  }
+
+  uint32_t match_empty() const noexcept {
+    return match(ctrl_empty);
+  }
+
+  // empty and deleted bytes are exactly the negative ones
+  uint32_t match_free() const noexcept {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(load());
+#else
+    return scalar_match([](int8_t c) { return c < 0; });
+#endif
+  }
+
+private:
+#ifdef __SSE2__
+  __m128i load() const noexcept {
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl));
+  }
+#else
+  template <typename F>
+  uint32_t scalar_match(F&& f) const noexcept {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < width; ++i) {
+      mask |= uint32_t(f(ctrl[i])) << i;
+    }
+    return mask;
+  }
+#endif
+
+  const int8_t* ctrl;
+};
+
+struct alignas(probe_group::width) ctrl_group {
+  int8_t bytes[probe_group::width];
+};
+
+// Hash of a key split into the group to start probing from and the seven
+// bits kept in the control byte. The multiply spreads identity hashes such
+// as std::hash<int> over both parts.
+struct split_hash {
+  explicit split_hash(size_t hash) noexcept {
+    hash *= size_t(0x9e3779b97f4a7c15);
+    hash ^= hash >> 29;
+    h1 = hash >> 7;
+    h2 = static_cast<int8_t>(hash & 0x7f);
+  }
+
+  size_t h1;
+  int8_t h2;
+};
+
+// One side of an unordered_bimap: control bytes and, per slot, the index of
+// the pair in the shared dense storage. Keys are read from that storage
+// through key_at, the table itself stores no keys.
+template <typename Hash, typename Equal, typename Tag>
+class hash_index : Hash, Equal {
+public:
+  static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+  hash_index(Hash hash, Equal equal)
+      : Hash(std::move(hash)), Equal(std::move(equal)) {}
+
+  size_t capacity() const noexcept {
+    return slots.size();
+  }
+
+  const Hash& hash_function() const noexcept {
+    return *this;
+  }
+
+  const Equal& key_eq() const noexcept {
+    return *this;
+  }
+
+  // Index of the pair with the given key or npos.
+  template <typename K, typename KeyAt>
+  uint32_t find(const K& key, KeyAt&& key_at) const {
+    return find(key, hash_function()(key), key_at);
+  }
+
+  // Same with the hash of key already computed, so that a caller going on
+  // to claim a slot for the key hashes it once.
+  template <typename K, typename KeyAt>
+  uint32_t find(const K& key, size_t hash, KeyAt&& key_at) const {
+    if (slots.empty()) {
+      return npos;
+    }
+
+    split_hash h(hash);
+    for (size_t step = 0, group = h.h1 & group_mask();;
+         group = (group + ++step) & group_mask()) {
+      probe_group probe(groups[group].bytes);
+      for (uint32_t mask = probe.match(h.h2); mask != 0; mask &= mask - 1) {
+        uint32_t index = slots[group * probe_group::width + ctz(mask)];
+        if (key_eq()(key_at(index), key)) {
+          return index;
+        }
+      }
+
+      if (probe.match_empty() != 0) {
+        return npos;
+      }
+    }
+  }
+
+  // Takes a free slot for a key known to be absent; the table must have a
+  // free slot. Returns the slot.
+  uint32_t claim(size_t hash, uint32_t index) noexcept {
+    split_hash h(hash);
+    for (size_t step = 0, group = h.h1 & group_mask();;
+         group = (group + ++step) & group_mask()) {
+      uint32_t mask = probe_group(groups[group].bytes).match_free();
+      if (mask != 0) {
+        size_t slot = group * probe_group::width + ctz(mask);
+        tombstones -= groups[group].bytes[ctz(mask)] == ctrl_deleted;
+        groups[group].bytes[ctz(mask)] = h.h2;
+        slots[slot] = index;
+        return static_cast<uint32_t>(slot);
+      }
+    }
+  }
+
+  // A slot in a group that still has an empty byte can become empty again:
+  // no probe ever continued past that group.
+  void release(uint32_t slot) noexcept {
+    auto& group = groups[slot / probe_group::width];
+    if (probe_group(group.bytes).match_empty() != 0) {
+      group.bytes[slot % probe_group::width] = ctrl_empty;
+    } else {
+      group.bytes[slot % probe_group::width] = ctrl_deleted;
+      ++tombstones;
+    }
+  }
+
+  void relink(uint32_t slot, uint32_t index) noexcept {
+    slots[slot] = index;
+  }
+
+  bool needs_rehash(size_t size) const noexcept {
+    return (size + tombstones + 1) * 8 > capacity() * 7;
+  }
+
+  struct storage {
+    std::vector<ctrl_group> groups;
+    std::vector<uint32_t> slots;
+  };
+
+  static storage allocate(size_t capacity) {
+    storage result{std::vector<ctrl_group>(capacity / probe_group::width),
+                   std::vector<uint32_t>(capacity, npos)};
+    for (auto& group : result.groups) {
+      std::fill(std::begin(group.bytes), std::end(group.bytes), ctrl_empty);
+    }
+    return result;
+  }
+
+  // Replaces every slot with the empty ones of fresh; the caller claims them
+  // again for all pairs.
+  void reset(storage&& fresh) noexcept {
+    groups.swap(fresh.groups);
+    slots.swap(fresh.slots);
+    tombstones = 0;
+  }
+
+  void swap(hash_index& other) noexcept {
+    std::swap(static_cast<Hash&>(*this), static_cast<Hash&>(other));
+    std::swap(static_cast<Equal&>(*this), static_cast<Equal&>(other));
+    groups.swap(other.groups);
+    slots.swap(other.slots);
+    std::swap(tombstones, other.tombstones);
+  }
+
+private:
+  static uint32_t ctz(uint32_t mask) noexcept {
+    return __builtin_ctz(mask);
+  }
+
+  size_t group_mask() const noexcept {
+    return groups.size() - 1;
+  }
+
+  std::vector<ctrl_group> groups;
+  std::vector<uint32_t> slots;
+  size_t tombstones = 0;
+};
+} // namespace bimap_impl
+
+// bimap без порядка на ключах: обе стороны -- хеш-таблицы с открытой
+// адресацией, которые ссылаются на общее плотное хранилище пар. Поиск
+// проверяет по 16 управляющих байт одной SSE2-инструкцией, поэтому find, at
+// и insert работают за O(1) в среднем.
+// Итераторы обходят пары в порядке хранилища. Вставка может инвалидировать
+// все итераторы; erase переносит последнюю пару на место удаленной, поэтому
+// инвалидирует итераторы на удаленную и на последнюю пары.
+template <typename Left, typename Right, typename HashLeft = std::hash<Left>,
+          typename HashRight = std::hash<Right>,
+          typename EqualLeft = std::equal_to<Left>,
+          typename EqualRight = std::equal_to<Right>>
+class unordered_bimap {
+public:
+  using left_tag = bimap_impl::left_tag;
+  using right_tag = bimap_impl::right_tag;
+
+  using left_t = Left;
+  using right_t = Right;
+
+  struct entry {
+    Left left;
+    Right right;
+    uint32_t left_slot;
+    uint32_t right_slot;
+  };
+
+  template <typename Tag, typename = void>
+  struct traits;
+
+  template <typename Dummy>
+  struct traits<left_tag, Dummy> {
+    using opposite = traits<right_tag>;
+    using tag = left_tag;
+    using half_t = Left;
+    using index_t = bimap_impl::hash_index<HashLeft, EqualLeft, left_tag>;
+
+    static const Left& key(const entry& e) noexcept {
+      return e.left;
+    }
+
+    static uint32_t& slot(entry& e) noexcept {
+      return e.left_slot;
+    }
+  };
+
+  template <typename Dummy>
+  struct traits<right_tag, Dummy> {
+    using opposite = traits<left_tag>;
+    using tag = right_tag;
+    using half_t = Right;
+    using index_t = bimap_impl::hash_index<HashRight, EqualRight, right_tag>;
+
+    static const Right& key(const entry& e) noexcept {
+      return e.right;
+    }
+
+    static uint32_t& slot(entry& e) noexcept {
+      return e.right_slot;
+    }
+  };
+
+  template <typename Tag>
+  class iterator_impl {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename traits<Tag>::half_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    iterator_impl() noexcept = default;
+
+    value_type const& operator*() const {
+      return traits<Tag>::key(map->entries[index]);
+    }
+
+    value_type const* operator->() const {
+      return &**this;
+    }
+
+    iterator_impl& operator++() {
+      ++index;
+      return *this;
+    }
+
+    iterator_impl operator++(int) {
+      auto copy = *this;
+      ++index;
+      return copy;
+    }
+
+    iterator_impl& operator--() {
+      --index;
+      return *this;
+    }
+
+    iterator_impl operator--(int) {
+      auto copy = *this;
+      --index;
+      return copy;
+    }
+
+    // Итератор на противоположный элемент той же пары, end() переходит в
+    // end() противоположной стороны.
+    iterator_impl<typename traits<Tag>::opposite::tag> flip() const {
+      return {map, index};
+    }
+
+    bool operator==(const iterator_impl& other) const noexcept {
+      return map == other.map && index == other.index;
+    }
+
+    bool operator!=(const iterator_impl& other) const noexcept {
+      return !(*this == other);
+    }
+
+    friend unordered_bimap;
+
+  private:
+    iterator_impl(const unordered_bimap* map, size_t index) noexcept
+        : map(map), index(index) {}
+
+    const unordered_bimap* map = nullptr;
+    size_t index = 0;
+  };
+
+  using left_iterator = iterator_impl<left_tag>;
+  using right_iterator = iterator_impl<right_tag>;
+
+  unordered_bimap(HashLeft hash_left = HashLeft(),
+                  HashRight hash_right = HashRight(),
+                  EqualLeft equal_left = EqualLeft(),
+                  EqualRight equal_right = EqualRight())
+      : indices(typename traits<left_tag>::index_t(std::move(hash_left),
+                                                   std::move(equal_left)),
+                typename traits<right_tag>::index_t(std::move(hash_right),
+                                                    std::move(equal_right))) {}
+
+  unordered_bimap(unordered_bimap const& other) = default;
+  unordered_bimap(unordered_bimap&& other) noexcept = default;
+
+  unordered_bimap& operator=(unordered_bimap const& other) {
+    unordered_bimap copy(other);
+    swap(copy);
+    return *this;
+  }
+
+  unordered_bimap& operator=(unordered_bimap&& other) noexcept {
+    unordered_bimap moved(std::move(other));
+    swap(moved);
+    return *this;
+  }
+
+  void swap(unordered_bimap& other) noexcept {
+    index<left_tag>().swap(other.index<left_tag>());
+    index<right_tag>().swap(other.index<right_tag>());
+    entries.swap(other.entries);
+  }
+
+  // Готовит таблицы к n парам без перестроения.
+  void reserve(size_t n) {
+    size_t capacity = probe_group::width;
+    while (capacity * 7 < (n + 1) * 8) {
+      capacity *= 2;
+    }
+
+    if (capacity > index<left_tag>().capacity()) {
+      rehash(capacity);
+    }
+    entries.reserve(n);
+  }
+
+  // Вставка пары (left, right), возвращает итератор на left.
+  // Если такой left или такой right уже присутствуют, вставка не
+  // производится и возвращается end_left().
+  // Каждый ключ хешируется один раз: хеш из проверки на повтор используется
+  // и для выбора слота.
+  left_iterator insert(left_t left, right_t right) {
+    size_t left_hash = index<left_tag>().hash_function()(left);
+    if (find_index<left_tag>(left, left_hash) != npos) {
+      return end_left();
+    }
+
+    size_t right_hash = index<right_tag>().hash_function()(right);
+    if (find_index<right_tag>(right, right_hash) != npos) {
+      return end_left();
+    }
+
+    if (entries.size() >= npos) {
+      throw std::length_error("unordered_bimap: too many pairs");
+    }
+
+    if (index<left_tag>().needs_rehash(size()) ||
+        index<right_tag>().needs_rehash(size())) {
+      grow();
+    }
+
+    auto position = static_cast<uint32_t>(entries.size());
+    entries.push_back({std::move(left), std::move(right), npos, npos});
+    entries.back().left_slot = index<left_tag>().claim(left_hash, position);
+    entries.back().right_slot = index<right_tag>().claim(right_hash, position);
+
+    return {this, position};
+  }
+
+  // Удаляет элемент и соответствующий ему парный, возвращает итератор на
+  // пару, перенесенную на место удаленной (или end()).
+  left_iterator erase_left(left_iterator it) {
+    erase_at(it.index);
+    return it;
+  }
+
+  bool erase_left(left_t const& left) {
+    return erase_key<left_tag>(left);
+  }
+
+  right_iterator erase_right(right_iterator it) {
+    erase_at(it.index);
+    return it;
+  }
+
+  bool erase_right(right_t const& right) {
+    return erase_key<right_tag>(right);
+  }
+
+  // Возвращает итератор по элементу. Если не найден - соответствующий end()
+  left_iterator find_left(left_t const& left) const {
+    return find_impl<left_tag>(left);
+  }
+
+  right_iterator find_right(right_t const& right) const {
+    return find_impl<right_tag>(right);
+  }
+
+  // Возвращает противоположный элемент по элементу
+  // Если элемента не существует -- бросает std::out_of_range
+  right_t const& at_left(left_t const& key) const {
+    return at_impl<left_tag>(key);
+  }
+
+  left_t const& at_right(right_t const& key) const {
+    return at_impl<right_tag>(key);
+  }
+
+  template <
+      typename Right1 = right_t,
+      typename = std::enable_if_t<std::is_default_constructible_v<Right1>>>
+  right_t const& at_left_or_default(left_t const& key) {
+    auto it = find_left(key);
+    if (it != end_left()) {
+      return *it.flip();
+    } else {
+      erase_right(right_t());
+      return *insert(key, right_t()).flip();
+    }
+  }
+
+  template <typename Left1 = left_t,
+            typename = std::enable_if_t<std::is_default_constructible_v<Left1>>>
+  left_t const& at_right_or_default(right_t const& key) {
+    auto it = find_right(key);
+    if (it != end_right()) {
+      return *it.flip();
+    } else {
+      erase_left(left_t());
+      return *insert(left_t(), key);
+    }
+  }
+
+  left_iterator begin_left() const {
+    return {this, 0};
+  }
+
+  left_iterator end_left() const {
+    return {this, entries.size()};
+  }
+
+  right_iterator begin_right() const {
+    return {this, 0};
+  }
+
+  right_iterator end_right() const {
+    return {this, entries.size()};
+  }
+
+  bool empty() const noexcept {
+    return entries.empty();
+  }
+
+  size_t size() const noexcept {
+    return entries.size();
+  }
+
+  // Равны, если совпадают множества пар, порядок хранения не важен. Ключи
+  // сравниваются предикатами EqualLeft и EqualRight из other.
+  bool operator==(unordered_bimap const& other) const {
+    if (size() != other.size()) {
+      return false;
+    }
+
+    auto const& equal_right = other.index<right_tag>().key_eq();
+    for (auto const& e : entries) {
+      uint32_t i = other.find_index<left_tag>(e.left);
+      if (i == npos || !equal_right(other.entries[i].right, e.right)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool operator!=(unordered_bimap const& other) const {
+    return !(*this == other);
+  }
+
+private:
+  using probe_group = bimap_impl::probe_group;
+  static constexpr uint32_t npos = traits<left_tag>::index_t::npos;
+
+  struct index_pair : traits<left_tag>::index_t, traits<right_tag>::index_t {
+    index_pair(typename traits<left_tag>::index_t left,
+               typename traits<right_tag>::index_t right)
+        : traits<left_tag>::index_t(std::move(left)),
+          traits<right_tag>::index_t(std::move(right)) {}
+  };
+
+  template <typename Tag>
+  auto& index() noexcept {
+    return static_cast<typename traits<Tag>::index_t&>(indices);
+  }
+
+  template <typename Tag>
+  const auto& index() const noexcept {
+    return static_cast<const typename traits<Tag>::index_t&>(indices);
+  }
+
+  template <typename Tag, typename K>
+  uint32_t find_index(const K& key) const {
+    return find_index<Tag>(key, index<Tag>().hash_function()(key));
+  }
+
+  template <typename Tag, typename K>
+  uint32_t find_index(const K& key, size_t hash) const {
+    return index<Tag>().find(key, hash, [this](uint32_t i) -> const auto& {
+      return traits<Tag>::key(entries[i]);
+    });
+  }
+
+  template <typename Tag, typename K>
+  iterator_impl<Tag> find_impl(const K& key) const {
+    uint32_t i = find_index<Tag>(key);
+    return {this, i == npos ? entries.size() : i};
+  }
+
+  template <typename Tag, typename K>
+  const auto& at_impl(const K& key) const {
+    uint32_t i = find_index<Tag>(key);
+    if (i == npos) {
+      throw std::out_of_range("unordered_bimap: out of range");
+    }
+
+    return traits<Tag>::opposite::key(entries[i]);
+  }
+
+  template <typename Tag, typename K>
+  bool erase_key(const K& key) {
+    uint32_t i = find_index<Tag>(key);
+    if (i == npos) {
+      return false;
+    }
+
+    erase_at(i);
+    return true;
+  }
+
+  // Frees both slots of the pair and moves the last pair into its place.
+  void erase_at(size_t i) {
+    index<left_tag>().release(entries[i].left_slot);
+    index<right_tag>().release(entries[i].right_slot);
+
+    if (i + 1 != entries.size()) {
+      entries[i] = std::move(entries.back());
+      index<left_tag>().relink(entries[i].left_slot, static_cast<uint32_t>(i));
+      index<right_tag>().relink(entries[i].right_slot, static_cast<uint32_t>(i));
+    }
+    entries.pop_back();
+  }
+
+  // Doubles the tables, or rebuilds them at the same size when most of the
+  // load is tombstones.
+  void grow() {
+    size_t capacity = index<left_tag>().capacity();
+    if (capacity == 0) {
+      capacity = probe_group::width;
+    } else if ((size() + 1) * 16 > capacity * 7) {
+      capacity *= 2;
+    }
+
+    rehash(capacity);
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<size_t> left_hashes, right_hashes;
+    left_hashes.reserve(size());
+    right_hashes.reserve(size());
+    for (auto const& e : entries) {
+      left_hashes.push_back(index<left_tag>().hash_function()(e.left));
+      right_hashes.push_back(index<right_tag>().hash_function()(e.right));
+    }
+
+    auto left_storage = traits<left_tag>::index_t::allocate(capacity);
+    auto right_storage = traits<right_tag>::index_t::allocate(capacity);
+    index<left_tag>().reset(std::move(left_storage));
+    index<right_tag>().reset(std::move(right_storage));
+    for (size_t i = 0; i < entries.size(); ++i) {
+      auto position = static_cast<uint32_t>(i);
+      entries[i].left_slot = index<left_tag>().claim(left_hashes[i], position);
+      entries[i].right_slot =
+          index<right_tag>().claim(right_hashes[i], position);
+    }
+  }
+
+  index_pair indices;
+  std::vector<entry> entries;
+};